@@ -0,0 +1,326 @@
+#include "render/render.h"
+#include "render/obj_parser.h"
+#include "render/scene_objects.h"
+#include "render/job_system.h"
+#include "render/mesh_optimizer.h"
+#include "render/vertex_dedup.h"
+#include <utils/tiny_obj_loader.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Welds an OBJ on position and UV like loadModel, runs the MeshOptimizer
+// passes over it and prints the vertex cache stats before and after.
+static int benchmarkMeshOptimizer(const std::string& path, uint32_t threadCount) {
+    ObjMesh mesh;
+    if (!ObjParser::parseFile(path, mesh, threadCount)) {
+        std::cerr << path << " needs the tinyobj fallback" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const uint32_t floatsPerVertex = 5;
+    std::vector<float> vecCorners(mesh.indices.size() * floatsPerVertex);
+    for (size_t i = 0; i < mesh.indices.size(); ++i) {
+        const ObjIndex& index = mesh.indices[i];
+        float* pCorner = &vecCorners[i * floatsPerVertex];
+        for (int axis = 0; axis < 3; ++axis) pCorner[axis] = mesh.vertices[3 * index.vertex + axis];
+        pCorner[3] = index.texcoord >= 0 ? mesh.texcoords[2 * index.texcoord + 0] : 0.0f;
+        pCorner[4] = index.texcoord >= 0 ? mesh.texcoords[2 * index.texcoord + 1] : 0.0f;
+    }
+
+    std::vector<uint32_t> vecIndices;
+    std::vector<uint32_t> vecFirstOccurrences;
+    VertexDedup::weld(vecCorners.data(), floatsPerVertex, mesh.indices.size(), vecIndices, vecFirstOccurrences, threadCount);
+    std::vector<float> vecVertices;
+    vecVertices.reserve(vecFirstOccurrences.size() * floatsPerVertex);
+    for (uint32_t corner : vecFirstOccurrences)
+        vecVertices.insert(vecVertices.end(), &vecCorners[corner * floatsPerVertex], &vecCorners[(corner + 1) * floatsPerVertex]);
+
+    size_t vertexCount = vecFirstOccurrences.size();
+    uint32_t stride = floatsPerVertex * sizeof(float);
+    VertexCacheStats before = MeshOptimizer::analyzeVertexCache(vecIndices, vertexCount);
+
+    auto start = std::chrono::steady_clock::now();
+    MeshOptimizer::optimizeVertexCache(vecIndices, vertexCount);
+    double cacheMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    VertexCacheStats afterCache = MeshOptimizer::analyzeVertexCache(vecIndices, vertexCount);
+
+    start = std::chrono::steady_clock::now();
+    MeshOptimizer::optimizeOverdraw(vecIndices, vecVertices.data(), stride, vertexCount);
+    double overdrawMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    vertexCount = MeshOptimizer::optimizeVertexFetch(vecIndices, vecVertices.data(), stride, vertexCount);
+    VertexCacheStats after = MeshOptimizer::analyzeVertexCache(vecIndices, vertexCount);
+
+    std::cout << path << ", " << vecIndices.size() / 3 << " triangles, " << vertexCount << " vertices, "
+              << MeshOptimizer::CACHE_SIZE << " entry cache\n";
+    std::cout << "welded: ACMR " << before.acmr << ", ATVR " << before.atvr << "\n";
+    std::cout << "vertex cache: ACMR " << afterCache.acmr << ", ATVR " << afterCache.atvr << ", " << cacheMs << " ms\n";
+    std::cout << "overdraw and fetch: ACMR " << after.acmr << ", ATVR " << after.atvr << ", " << overdrawMs << " ms\n";
+    return EXIT_SUCCESS;
+}
+
+// Parses the same in-memory OBJ with tinyobj and with ObjParser on one and on
+// threadCount threads, best of a few runs each, and prints MB/s.
+static int benchmarkObjParser(const std::string& path, uint32_t threadCount) {
+    std::vector<char> buffer = readFile(path);
+    double megabytes = buffer.size() / (1024.0 * 1024.0);
+    const int runs = 5;
+
+    auto best = [&](auto&& parse) {
+        double bestMs = 0.0;
+        for (int run = 0; run < runs; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            parse();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (run == 0 || ms < bestMs) bestMs = ms;
+        }
+        return bestMs;
+    };
+    auto print = [&](const std::string& name, double ms) {
+        std::cout << name << ": " << ms << " ms, " << megabytes / (ms / 1000.0) << " MB/s\n";
+    };
+
+    double tinyobjMs = best([&]() {
+        std::istringstream stream(std::string(buffer.data(), buffer.size()));
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warn, err;
+        tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &stream);
+    });
+
+    ObjMesh mesh;
+    bool supported = true;
+    double singleMs = best([&]() { supported = ObjParser::parse(buffer.data(), buffer.size(), mesh, 1); });
+    double multiMs = best([&]() { supported = ObjParser::parse(buffer.data(), buffer.size(), mesh, threadCount); });
+    if (!supported) {
+        std::cerr << path << " needs the tinyobj fallback" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << path << ", " << megabytes << " MB, " << mesh.indices.size() / 3 << " triangles\n";
+    print("tinyobj", tinyobjMs);
+    print("ObjParser 1 thread", singleMs);
+    print("ObjParser " + std::to_string(threadCount) + " threads", multiMs);
+    return EXIT_SUCCESS;
+}
+
+// Culls objectCount random boxes against the default camera with the scalar
+// loop, SceneObjects::cull on one thread and on threadCount threads, best of a
+// few runs each, and prints millions of objects per second.
+static int benchmarkCulling(uint32_t objectCount, uint32_t threadCount) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> size(0.1f, 2.0f);
+    SceneObjects objects;
+    for (uint32_t i = 0; i < objectCount; ++i) {
+        glm::vec3 center(position(rng), position(rng), position(rng));
+        glm::vec3 extent(size(rng), size(rng), size(rng));
+        objects.add(center - extent, center + extent);
+    }
+
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), 1.5f, 0.01f, 100.0f);
+    proj[1][1] *= -1;
+    glm::mat4 view = glm::lookAt(glm::vec3(2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    Frustum frustum = Frustum::fromMatrix(proj * view);
+    const int runs = 20;
+
+    std::vector<SceneObjects::Handle> vecVisible;
+    auto best = [&](auto&& cull) {
+        double bestMs = 0.0;
+        for (int run = 0; run < runs; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            cull();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (run == 0 || ms < bestMs) bestMs = ms;
+        }
+        return bestMs;
+    };
+    auto print = [&](const std::string& name, double ms) {
+        std::cout << name << ": " << ms << " ms, " << objectCount / (ms * 1000.0) << " M objects/s\n";
+    };
+
+    std::vector<SceneObjects::Handle> vecReference;
+    double scalarMs = best([&]() { objects.cullScalar(frustum, vecReference); });
+    double singleMs = best([&]() { objects.cull(frustum, vecVisible, 1); });
+    double multiMs = best([&]() { objects.cull(frustum, vecVisible, threadCount); });
+    if (vecVisible != vecReference) {
+        std::cerr << "SIMD culling disagrees with the scalar loop" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << objectCount << " objects, " << vecVisible.size() << " visible\n";
+    print("scalar", scalarMs);
+    print(std::string(SceneObjects::getSimdName()) + " 1 thread", singleMs);
+    print(std::string(SceneObjects::getSimdName()) + " " + std::to_string(threadCount) + " threads", multiMs);
+    return EXIT_SUCCESS;
+}
+
+// JobSystem overhead and scaling: cost of an empty job and of a dependent
+// graph task, a fixed amount of work spread over 1..threadCount threads, and
+// a small parallelFor as jobs against one that starts its own threads.
+static int benchmarkJobs(uint32_t threadCount) {
+    using Clock = std::chrono::steady_clock;
+    auto elapsedMs = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    std::vector<uint32_t> vecOverheadThreads = { 1 };
+    if (threadCount > 1) vecOverheadThreads.push_back(threadCount);
+    for (uint32_t threads : vecOverheadThreads) {
+        JobSystem jobs;
+        jobs.init(threads - 1);
+
+        const uint32_t jobCount = 100000;
+        JobSystem::Counter counter;
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < jobCount; ++i) jobs.run([]() {}, counter);
+        jobs.wait(counter);
+        double emptyMs = elapsedMs(start);
+
+        // each task waits on the previous one, nothing can overlap
+        const uint32_t chainLength = 10000;
+        JobSystem::TaskGraph graph;
+        for (uint32_t i = 0; i < chainLength; ++i) {
+            JobSystem::TaskGraph::TaskId id = graph.add([]() {});
+            if (i > 0) graph.addDependency(id - 1, id);
+        }
+        start = Clock::now();
+        jobs.run(graph, counter);
+        jobs.wait(counter);
+        double chainMs = elapsedMs(start);
+
+        std::cout << threads << " threads: empty job " << emptyMs * 1e6 / jobCount << " ns, chained task "
+                  << chainMs * 1e6 / chainLength << " ns\n";
+    }
+
+    // the same 1024 slices of arithmetic at every thread count
+    const uint32_t sliceCount = 1024;
+    std::vector<float> vecResults(sliceCount);
+    auto slice = [&](size_t i) {
+        float sum = 0.0f;
+        for (uint32_t k = 1; k < 20000; ++k) sum += std::sqrt(static_cast<float>(k + i));
+        vecResults[i] = sum;
+    };
+    std::vector<uint32_t> vecThreadCounts;
+    for (uint32_t threads = 1; threads < threadCount; threads *= 2) vecThreadCounts.push_back(threads);
+    vecThreadCounts.push_back(threadCount);
+    double baseMs = 0.0;
+    for (uint32_t threads : vecThreadCounts) {
+        JobSystem jobs;
+        jobs.init(threads - 1);
+        auto start = Clock::now();
+        JobSystem::Counter counter;
+        for (uint32_t i = 0; i < sliceCount; ++i) jobs.run([&, i]() { slice(i); }, counter);
+        jobs.wait(counter);
+        double ms = elapsedMs(start);
+        if (threads == 1) baseMs = ms;
+        std::cout << "work on " << threads << " threads: " << ms << " ms, " << baseMs / ms << "x\n";
+    }
+
+    // a per-frame sized parallelFor: culling or recording a handful of batches
+    const uint32_t callCount = 1000;
+    std::atomic<uint32_t> sink{ 0 };
+    auto start = Clock::now();
+    for (uint32_t call = 0; call < callCount; ++call)
+        parallelFor(threadCount, threadCount, [&](size_t i) { sink += static_cast<uint32_t>(i); });
+    double threadMs = elapsedMs(start);
+    JobSystem jobs;
+    jobs.init(threadCount - 1);
+    start = Clock::now();
+    for (uint32_t call = 0; call < callCount; ++call)
+        parallelFor(threadCount, threadCount, [&](size_t i) { sink += static_cast<uint32_t>(i); });
+    double jobMs = elapsedMs(start);
+    std::cout << "parallelFor over " << threadCount << " items: " << threadMs * 1000.0 / callCount
+              << " us with new threads, " << jobMs * 1000.0 / callCount << " us as jobs\n";
+    return EXIT_SUCCESS;
+}
+
+// Drives the frame loop for a fixed number of frames and reports CPU timings.
+//   learnVulkan_bench [--frames N] [--warmup N] [--headless] [--instances N] [--threads N]
+//                     [--resize-every N]
+//   learnVulkan_bench --parse-obj <path> [--threads N]
+//   learnVulkan_bench --optimize-obj <path> [--threads N]
+//   learnVulkan_bench --cull-objects N [--threads N]
+//   learnVulkan_bench --jobs [--threads N]
+int main(int argc, char *argv[]) {
+    uint32_t frameCount = 1000;
+    uint32_t warmupFrames = 60;
+    bool headless = false;
+    uint32_t instanceCount = 0;
+    std::string objPath;
+    std::string optimizeObjPath;
+    uint32_t cullObjectCount = 0;
+    bool jobsBenchmark = false;
+    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t resizeInterval = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+            instanceCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--parse-obj") == 0 && i + 1 < argc)
+            objPath = argv[++i];
+        else if (strcmp(argv[i], "--optimize-obj") == 0 && i + 1 < argc)
+            optimizeObjPath = argv[++i];
+        else if (strcmp(argv[i], "--jobs") == 0)
+            jobsBenchmark = true;
+        else if (strcmp(argv[i], "--cull-objects") == 0 && i + 1 < argc)
+            cullObjectCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threadCount = std::max(1u, static_cast<uint32_t>(std::stoul(argv[++i])));
+        else if (strcmp(argv[i], "--resize-every") == 0 && i + 1 < argc)
+            resizeInterval = static_cast<uint32_t>(std::stoul(argv[++i]));
+    }
+
+    try {
+        if (!objPath.empty())
+            return benchmarkObjParser(objPath, threadCount);
+        if (!optimizeObjPath.empty())
+            return benchmarkMeshOptimizer(optimizeObjPath, threadCount);
+        if (cullObjectCount > 0)
+            return benchmarkCulling(cullObjectCount, threadCount);
+        if (jobsBenchmark)
+            return benchmarkJobs(threadCount);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    HelloTriangleApplication app;
+    app.setStressInstanceCount(instanceCount);
+    app.setRecordThreadCount(threadCount);
+    app.setResizeInterval(resizeInterval);
+    try {
+        app.runBenchmark(frameCount, warmupFrames, headless);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << (headless ? "headless" : "windowed") << ", "
+              << frameCount << " frames after " << warmupFrames << " warmup frames";
+    if (instanceCount > 0) std::cout << ", " << instanceCount << " instances";
+    if (resizeInterval > 0 && !headless) std::cout << ", resize every " << resizeInterval << " frames";
+    std::cout << "\n";
+    app.getFrameTimer().report(std::cout);
+
+    // rolling window over the last GpuProfiler::HISTORY_SIZE frames
+    for (const auto& stats : app.getGpuTimings())
+        std::cout << "gpu " << stats.name << ": last " << stats.lastMs
+                  << " ms, avg " << stats.avgMs << " ms, min " << stats.minMs
+                  << " ms, max " << stats.maxMs << " ms (" << stats.sampleCount << " samples)\n";
+
+    return EXIT_SUCCESS;
+}
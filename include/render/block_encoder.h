@@ -0,0 +1,36 @@
+#pragma once
+
+#include "render/texture_cache.h"
+
+#include <cstdint>
+#include <vector>
+
+enum class BlockFormat {
+    // RGB, 8 bytes per block
+    eBC1,
+    // BC1 color plus a separate 8-byte alpha block
+    eBC3,
+    // RGBA, mode 6 only (one subset, 7.7.7.7 endpoints, 4-bit indices)
+    eBC7,
+};
+
+// CPU encoder for 4x4 block-compressed textures. Endpoints come from the
+// block's principal axis and are refined once by least squares; indices are
+// picked by exhaustive search over the palette, with SSE2 or AVX when the
+// target has them and a scalar loop otherwise.
+class BlockEncoder {
+public:
+    static constexpr uint32_t BLOCK_EXTENT = 4;
+
+    static uint32_t getBlockBytes(BlockFormat format);
+
+    // Encodes one block from 16 row-major RGBA8 texels.
+    static void encodeBlock(BlockFormat format, const uint8_t* pTexels, uint8_t* pBlock);
+
+    // Encodes every level of an RGBA8 chain laid out as TextureCache::buildMipChain
+    // returns it. Partial edge blocks repeat the last row and column. Block rows
+    // of all levels are shared out over threadCount threads.
+    static std::vector<uint8_t> encodeMipChain(BlockFormat format, const uint8_t* pTexels,
+        const std::vector<TextureLevel>& vecSourceLevels, std::vector<TextureLevel>& vecLevels,
+        uint32_t threadCount = 1);
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include "render/memory_type_selector.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct MemoryBlock;
+
+// A range of device memory handed out by DeviceAllocator. Host-visible
+// memory is mapped for the lifetime of its block, pMapped points at offset.
+struct MemoryAllocation {
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    void* pMapped = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    MemoryBlock* pBlock = nullptr;  // null for dedicated allocations
+
+    explicit operator bool() const { return static_cast<bool>(memory); }
+};
+
+// Resources that must not share a bufferImageGranularity page are kept apart.
+enum class ResourceKind {
+    eLinear,    // buffers and linear-tiling images
+    eOptimal    // optimal-tiling images
+};
+
+// Block sub-allocator: one pool of large vk::DeviceMemory blocks per memory
+// type and resource kind, carved up with a best-fit free list. Big images and
+// anything larger than half a block get their own dedicated allocation.
+class DeviceAllocator {
+public:
+    static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+    static constexpr vk::DeviceSize DEDICATED_IMAGE_THRESHOLD = 8ull << 20;
+
+    struct HeapStats {
+        vk::DeviceSize usedBytes = 0;
+        vk::DeviceSize reservedBytes = 0;
+        vk::DeviceSize freeBytes = 0;
+        vk::DeviceSize largestFreeRange = 0;
+        uint32_t blockCount = 0;
+        uint32_t dedicatedCount = 0;
+        uint32_t allocationCount = 0;
+        // 0 when all free space is one range, approaching 1 as it splinters
+        float fragmentation = 0.0f;
+    };
+
+    DeviceAllocator();
+    ~DeviceAllocator();
+
+    void init(vk::PhysicalDevice physicalDevice, vk::Device device, vk::DeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+    void destroy();
+
+    MemoryAllocation allocate(const vk::MemoryRequirements& requirements, uint32_t memoryTypeIndex, ResourceKind kind);
+    void free(MemoryAllocation& allocation);
+
+    const MemoryTypeSelector& getMemoryTypeSelector() const { return m_MemoryTypeSelector; }
+
+    std::vector<HeapStats> getHeapStats() const;
+    // number of live vkAllocateMemory objects, bounded by maxMemoryAllocationCount
+    uint32_t getDeviceMemoryCount() const { return m_DeviceMemoryCount; }
+
+private:
+    struct Pool {
+        uint32_t memoryTypeIndex = 0;
+        std::vector<std::unique_ptr<MemoryBlock>> blocks;
+    };
+
+    vk::DeviceMemory allocateDeviceMemory(vk::DeviceSize size, uint32_t memoryTypeIndex, void** ppMapped);
+    void freeDeviceMemory(vk::DeviceMemory memory);
+    vk::DeviceSize blockSizeForType(uint32_t memoryTypeIndex) const;
+
+    vk::Device m_Device;
+    MemoryTypeSelector m_MemoryTypeSelector;
+    vk::PhysicalDeviceMemoryProperties m_MemoryProperties;
+    vk::DeviceSize m_BlockSize = DEFAULT_BLOCK_SIZE;
+    vk::DeviceSize m_BufferImageGranularity = 1;
+    uint32_t m_DeviceMemoryCount = 0;
+    uint32_t m_MaxDeviceMemoryCount = 0;
+
+    std::vector<Pool> m_vecPools;
+    std::vector<MemoryAllocation> m_vecDedicated;
+};
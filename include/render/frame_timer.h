@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// CPU-side timing samples for the frame loop, one series per section.
+class FrameTimer {
+public:
+    enum Section : uint32_t {
+        eFrame = 0,
+        eWaitForFences,
+        eAcquireNextImage,
+        ePresent,
+        eRecordCommands,
+        eRecreateSwapChain,
+        eSectionCount
+    };
+
+    struct Summary {
+        size_t count = 0;
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    // Records the lifetime of the scope into a section, in milliseconds.
+    class Scope {
+    public:
+        Scope(FrameTimer& timer, Section section) :
+            m_Timer(timer), m_Section(section), m_Start(std::chrono::steady_clock::now()) {}
+        ~Scope() {
+            m_Timer.record(m_Section, std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - m_Start).count());
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        FrameTimer& m_Timer;
+        Section m_Section;
+        std::chrono::steady_clock::time_point m_Start;
+    };
+
+    void setEnabled(bool enabled) { m_Enabled = enabled; }
+    bool isEnabled() const { return m_Enabled; }
+
+    void reserve(size_t frameCount);
+    void reset();
+    void record(Section section, double milliseconds);
+
+    Summary summarize(Section section) const;
+    void report(std::ostream& os) const;
+
+    static const char* sectionName(Section section);
+
+private:
+    bool m_Enabled = false;
+    std::array<std::vector<double>, eSectionCount> m_vecSamples;
+};
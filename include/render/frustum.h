@@ -0,0 +1,16 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Six planes facing inward, xyz normalized so dot(xyz, p) + w is a distance.
+// Order: left, right, bottom, top, near, far.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Extracts the planes of a clip matrix with Vulkan's [0, 1] depth range
+    // (Gribb and Hartmann). Passing proj * view * model yields planes in the
+    // space the model matrix is applied to.
+    static Frustum fromMatrix(const glm::mat4& clip);
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <glm/glm.hpp>
+
+#include "render/device_allocator.h"
+#include "render/mesh_cache.h"
+
+#include <cstdint>
+#include <vector>
+
+// Frustum culling and LOD selection per instance in a compute pass
+// (cull.comp). Every submesh of every LOD owns a fixed
+// VkDrawIndexedIndirectCommand; survivors bump its instanceCount and append
+// their index to the LOD's run of the visible list. The graphics pass then
+// draws everything with one drawIndexedIndirect, so CPU cost per frame does
+// not depend on the instance count.
+//
+// shader.vert reads visibleInstances[visibleBase + gl_InstanceIndex]. With
+// multiDrawIndirect and drawIndirectFirstInstance the LOD's base rides in
+// firstInstance; without them each command is drawn on its own and the base
+// is pushed as a constant.
+class GpuCuller {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+    // matches CullUniforms in cull.comp
+    struct Uniforms {
+        glm::vec4 planes[6];
+        // view space depth as a plane
+        glm::vec4 depthPlane;
+        // object space bounding sphere, xyz center and w radius
+        glm::vec4 meshSphere;
+        // x pixels per unit of error at depth 1, y pixel error threshold, z model scale
+        glm::vec4 lodParams;
+        uint32_t instanceCount;
+        uint32_t lodCount;
+    };
+
+    // uniformBuffer and instanceBuffer are bound with dynamic offsets picked in record().
+    void init(vk::PhysicalDevice physicalDevice, vk::Device device, DeviceAllocator* pAllocator,
+        vk::PipelineCache pipelineCache, const std::vector<char>& shaderCode, const MeshView& mesh,
+        vk::Buffer uniformBuffer, vk::Buffer instanceBuffer, vk::DeviceSize instanceRange,
+        uint32_t instanceCapacity, uint32_t framesInFlight);
+    void destroy();
+
+    // Terms for the same matrices shader.vert applies, instances included.
+    Uniforms buildUniforms(const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj,
+        float viewportHeight, float pixelError, uint32_t instanceCount) const;
+
+    // Outside a render pass: resets the frame's commands, culls, and makes the
+    // results visible to indirect draws and vertex shaders.
+    void record(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t uniformOffset,
+        uint32_t instanceOffset, uint32_t instanceCount);
+    // Inside the render pass with the graphics pipeline bound; layout must
+    // have a uint vertex push constant at offset 0. Draws commands
+    // [firstCommand, firstCommand + commandCount) so several secondary
+    // command buffers can share the list.
+    void draw(vk::CommandBuffer commandBuffer, uint32_t frame, vk::PipelineLayout layout,
+        uint32_t firstCommand, uint32_t commandCount);
+
+    bool usesMultiDraw() const { return m_MultiDraw; }
+    uint32_t getCommandCount() const { return m_CommandCount; }
+    // commands are grouped by LOD, finest first; lodCount gives the end of the list
+    uint32_t getLodCount() const { return static_cast<uint32_t>(m_vecLods.size()); }
+    uint32_t getLodFirstCommand(uint32_t lod) const { return lod < m_vecLods.size() ? m_vecLods[lod].firstCommand : m_CommandCount; }
+    vk::Buffer getVisibleBuffer() const { return m_VisibleBuffer; }
+    vk::DeviceSize getVisibleFrameSize() const { return m_VisibleFrameSize; }
+
+private:
+    // matches Lod in cull.comp
+    struct GpuLod {
+        float error;
+        uint32_t firstCommand;
+        uint32_t commandCount;
+        uint32_t visibleBase;
+    };
+
+    void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties,
+        MemoryUsage memoryUsage, vk::Buffer& buffer, MemoryAllocation& memory);
+    void createPipeline(vk::PipelineCache pipelineCache, const std::vector<char>& shaderCode);
+    void createDescriptorSet(vk::Buffer uniformBuffer, vk::Buffer instanceBuffer, vk::DeviceSize instanceRange);
+
+    vk::Device m_Device;
+    DeviceAllocator* m_pAllocator = nullptr;
+    bool m_MultiDraw = false;
+
+    glm::vec4 m_MeshSphere{ 0.0f };
+    std::vector<GpuLod> m_vecLods;
+    // LOD of every command, for the per-command fallback
+    std::vector<uint32_t> m_vecCommandLods;
+    uint32_t m_CommandCount = 0;
+
+    vk::DescriptorSetLayout m_DescriptorSetLayout;
+    vk::DescriptorPool m_DescriptorPool;
+    vk::DescriptorSet m_DescriptorSet;
+    vk::PipelineLayout m_PipelineLayout;
+    vk::Pipeline m_Pipeline;
+
+    // commands with zero instances, copied over the frame's region before culling
+    vk::Buffer m_TemplateBuffer;
+    MemoryAllocation m_TemplateMemory;
+    vk::Buffer m_LodBuffer;
+    MemoryAllocation m_LodMemory;
+    vk::Buffer m_CommandBuffer;
+    MemoryAllocation m_CommandMemory;
+    vk::DeviceSize m_CommandFrameSize = 0;
+    vk::Buffer m_VisibleBuffer;
+    MemoryAllocation m_VisibleMemory;
+    vk::DeviceSize m_VisibleFrameSize = 0;
+};
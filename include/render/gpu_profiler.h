@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Timestamp queries around named scopes, one query pool per frame in flight.
+// Results are read back once the frame's in-flight fence has been waited on,
+// so collection never stalls the CPU on the GPU.
+class GpuProfiler {
+public:
+    static constexpr uint32_t MAX_SCOPES = 32;
+    static constexpr size_t HISTORY_SIZE = 128;
+
+    struct Stats {
+        std::string name;
+        size_t sampleCount = 0;
+        double lastMs = 0.0;
+        double avgMs = 0.0;
+        double minMs = 0.0;
+        double maxMs = 0.0;
+    };
+
+    void init(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t queueFamilyIndex, uint32_t framesInFlight);
+    void destroy();
+
+    bool isSupported() const { return m_Supported; }
+
+    // Scopes are registered once up front, the returned id is used every frame.
+    uint32_t registerScope(const std::string& name);
+
+    // Call right after the frame's fence was waited on.
+    void collect(uint32_t frame);
+    // Call at the start of the frame's command buffer, outside any render pass.
+    void beginFrame(vk::CommandBuffer commandBuffer, uint32_t frame);
+    void beginScope(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t scope);
+    void endScope(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t scope);
+
+    Stats getStats(uint32_t scope) const;
+    std::vector<Stats> getAllStats() const;
+
+private:
+    struct ScopeHistory {
+        std::string name;
+        std::vector<double> samples;
+        size_t next = 0;
+        size_t count = 0;
+    };
+
+    vk::Device m_Device;
+    bool m_Supported = false;
+    double m_TimestampPeriodNs = 1.0;
+    uint64_t m_TimestampMask = ~0ull;
+
+    std::vector<vk::QueryPool> m_vecQueryPools;
+    std::vector<uint32_t> m_vecWrittenScopes;
+    std::vector<ScopeHistory> m_vecScopes;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Affine model matrix stored as its first three rows, read by shader.vert
+// from a storage buffer through gl_InstanceIndex.
+struct InstanceData {
+    glm::vec4 rows[3];
+};
+
+// Per-instance transforms in one persistently mapped storage buffer with a
+// region per frame in flight. Instances stay densely packed so one culling
+// dispatch covers all of them; removing one moves the last into its slot.
+// Each region is only rewritten over the slots that changed since that frame
+// last used it.
+class InstanceBuffer {
+public:
+    using Handle = uint32_t;
+
+    void init(vk::Buffer buffer, void* pMapped, uint32_t capacity, uint32_t frameCount, vk::DeviceSize alignment);
+
+    Handle add(const glm::mat4& model);
+    // remove and update throw on a handle that is not live
+    void remove(Handle handle);
+    void update(Handle handle, const glm::mat4& model);
+    void clear();
+
+    // Only call once the frame's fence has signalled. Returns the dynamic
+    // offset of the frame's region.
+    uint32_t beginFrame(uint32_t frame);
+
+    vk::Buffer getBuffer() const { return m_Buffer; }
+    vk::DeviceSize getFrameSize() const { return m_FrameSize; }
+    uint32_t getCapacity() const { return m_Capacity; }
+    uint32_t getCount() const { return static_cast<uint32_t>(m_vecInstances.size()); }
+
+private:
+    struct DirtyRange {
+        uint32_t begin = UINT32_MAX;
+        uint32_t end = 0;
+    };
+
+    uint32_t slotOf(Handle handle) const;
+    void markDirty(uint32_t slot);
+    void store(uint32_t slot, const glm::mat4& model);
+
+    vk::Buffer m_Buffer;
+    uint8_t* m_pMapped = nullptr;
+    vk::DeviceSize m_FrameSize = 0;
+    uint32_t m_Capacity = 0;
+
+    std::vector<InstanceData> m_vecInstances;
+    // handles stay valid while slots move; freed handles are reused and map to INVALID_SLOT
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+    std::vector<uint32_t> m_vecSlotOfHandle;
+    std::vector<Handle> m_vecHandleOfSlot;
+    std::vector<Handle> m_vecFreeHandles;
+    std::vector<DirtyRange> m_vecDirty;
+};
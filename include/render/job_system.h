@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing scheduler. Every worker owns a deque: it pushes and pops its
+// own jobs at the back and steals from the front of the others when it runs
+// dry. Threads that are not workers, the main thread included, share deque 0.
+//
+// Jobs report to a Counter; wait() runs other jobs until it drops to zero, so
+// waiting from inside a job is fine. The first exception a job throws is
+// rethrown by wait().
+class JobSystem {
+public:
+    using Job = std::function<void()>;
+
+    class Counter {
+    public:
+        bool isDone() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        void fail(std::exception_ptr exception);
+
+        std::atomic<uint32_t> m_Pending{ 0 };
+        std::atomic<bool> m_Failed{ false };
+        std::mutex m_ExceptionMutex;
+        std::exception_ptr m_Exception;
+    };
+
+    // Jobs with dependencies, each scheduled once everything it depends on has
+    // finished. Ids follow add() order and a dependency has to point forward,
+    // so a graph cannot have cycles. Must outlive the wait on its counter.
+    class TaskGraph {
+    public:
+        using TaskId = uint32_t;
+
+        TaskId add(Job job);
+        void addDependency(TaskId before, TaskId after);
+        size_t getTaskCount() const { return m_vecTasks.size(); }
+
+    private:
+        friend class JobSystem;
+        struct Task {
+            Job job;
+            std::vector<TaskId> vecSuccessors;
+            uint32_t dependencyCount = 0;
+        };
+
+        std::vector<Task> m_vecTasks;
+        std::unique_ptr<std::atomic<uint32_t>[]> m_pRemaining;
+    };
+
+    ~JobSystem() { shutdown(); }
+
+    // workerCount threads besides the callers; 0 runs everything inside wait().
+    void init(uint32_t workerCount);
+    void shutdown();
+
+    void run(Job job, Counter& counter);
+    // once a task throws, tasks that have not started are skipped; the counter still drains
+    void run(TaskGraph& graph, Counter& counter);
+    void wait(Counter& counter);
+
+    // func(i) for every i in [0, count) on up to batchCount jobs that hand out
+    // indices one at a time; the caller works on one of them.
+    void parallelFor(size_t count, uint32_t batchCount, const std::function<void(size_t)>& func);
+
+    // workers plus the thread that waits
+    uint32_t getThreadCount() const { return std::max<uint32_t>(1, static_cast<uint32_t>(m_vecWorkers.size())); }
+
+    // The first system initialized; parallelFor() in parallel_for.h schedules onto it.
+    static JobSystem* getActive() { return s_pActive.load(std::memory_order_acquire); }
+
+private:
+    struct Entry {
+        Job job;
+        Counter* pCounter = nullptr;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Entry> entries;
+        std::thread thread;
+    };
+
+    void push(Entry entry);
+    bool tryPop(uint32_t workerIndex, Entry& entry);
+    void execute(Entry& entry);
+    void scheduleTask(TaskGraph& graph, TaskGraph::TaskId id, Counter& counter);
+    void workerLoop(uint32_t workerIndex);
+    uint32_t currentWorkerIndex() const;
+
+    // slot 0 has no thread, it belongs to whoever is not a worker
+    std::vector<std::unique_ptr<Worker>> m_vecWorkers;
+    std::atomic<uint32_t> m_QueuedCount{ 0 };
+    std::atomic<uint32_t> m_SleepingCount{ 0 };
+    std::mutex m_SleepMutex;
+    std::condition_variable m_SleepCondition;
+    bool m_Stopping = false;
+
+    static std::atomic<JobSystem*> s_pActive;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are faulted in on first
+// touch, so opening costs the same whatever the file size.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false when the file is missing or cannot be mapped.
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return m_pData != nullptr; }
+    const uint8_t* getData() const { return m_pData; }
+    size_t getSize() const { return m_Size; }
+
+private:
+    const uint8_t* m_pData = nullptr;
+    size_t m_Size = 0;
+#ifdef _WIN32
+    void* m_hFile = nullptr;
+    void* m_hMapping = nullptr;
+#endif
+};
+
+struct FileSpan {
+    const void* pData;
+    size_t size;
+};
+
+// Writes the spans back to back into path.tmp and renames it over path, so
+// readers never map a half written file. Returns false on any I/O error.
+bool writeFileAtomic(const std::string& path, std::initializer_list<FileSpan> spans);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <optional>
+
+// How the CPU and GPU will touch a resource; drives the optional preferences
+// layered on top of the mandatory property flags.
+enum class MemoryUsage {
+    eGpuOnly,       // static data, keep it out of host-visible heaps
+    eTransient,     // attachments that never leave the tile, lazily allocated if possible
+    eUpload,        // staging written once by the CPU and copied on the GPU
+    eDynamic,       // rewritten by the CPU every frame, read by the GPU
+    eReadback       // written by the GPU, read back by the CPU
+};
+
+// Caches the device memory properties once and picks the best memory type
+// that has all required flags, ranked by a per-usage preference score.
+class MemoryTypeSelector {
+public:
+    void init(vk::PhysicalDevice physicalDevice);
+
+    const vk::PhysicalDeviceMemoryProperties& getProperties() const { return m_MemoryProperties; }
+
+    std::optional<uint32_t> find(uint32_t typeFilter, vk::MemoryPropertyFlags required, MemoryUsage usage) const;
+    // like find(), but throws when no memory type qualifies
+    uint32_t select(uint32_t typeFilter, vk::MemoryPropertyFlags required, MemoryUsage usage) const;
+
+private:
+    int score(uint32_t memoryTypeIndex, MemoryUsage usage) const;
+
+    vk::PhysicalDeviceMemoryProperties m_MemoryProperties;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "render/mapped_file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MeshVertexAttribute {
+    uint32_t location;
+    // a VkFormat value, kept numeric so the cache does not depend on Vulkan headers
+    uint32_t format;
+    uint32_t offset;
+};
+
+// Describes the vertex blob; a cache written with another layout is rebuilt.
+struct MeshLayout {
+    uint32_t vertexStride = 0;
+    std::vector<MeshVertexAttribute> attributes;
+};
+
+// Import options that change the baked mesh; a cache written with other settings is rebuilt.
+struct MeshBuildSettings {
+    uint32_t lodLevelCount = 1;
+    uint32_t splitLargeMeshes = 0;
+    uint32_t optimizeOverdraw = 0;
+};
+
+struct MeshBounds {
+    float min[3] = { 0.0f, 0.0f, 0.0f };
+    float max[3] = { 0.0f, 0.0f, 0.0f };
+};
+
+// Decodes quantized attributes as stored * scale + offset; identity for float layouts.
+struct MeshDequantize {
+    float positionScale[3] = { 1.0f, 1.0f, 1.0f };
+    float positionOffset[3] = { 0.0f, 0.0f, 0.0f };
+    float texCoordScale[2] = { 1.0f, 1.0f };
+    float texCoordOffset[2] = { 0.0f, 0.0f };
+};
+
+// One drawIndexed range; 16-bit meshes over 65536 vertices are split into several.
+struct SubMesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+};
+
+// A level of detail is a run of submeshes; level 0 is the full mesh. error is
+// the object space distance the level strays from the full mesh.
+struct MeshLod {
+    float error;
+    uint32_t firstSubMesh;
+    uint32_t subMeshCount;
+};
+
+// Non-owning view of mesh data ready for upload.
+struct MeshView {
+    const void* pVertices = nullptr;
+    uint64_t vertexCount = 0;
+    const void* pIndices = nullptr;
+    uint64_t indexCount = 0;
+    // 2 or 4 bytes
+    uint32_t indexSize = 4;
+    std::vector<SubMesh> subMeshes;
+    // finest first
+    std::vector<MeshLod> lods;
+    MeshBounds bounds;
+    MeshDequantize dequantize;
+};
+
+// Binary mesh written after the first import of a source file. It holds a
+// header, the vertex layout, the submesh and LOD tables, the vertex and index
+// blobs and the bounds. Warm starts map it and hand out pointers into the
+// mapping, so no parsing or welding happens and the cost no longer depends on
+// the mesh size.
+//
+// The cache is keyed on the source's SourceKey, the layout and the build settings.
+class MeshCache {
+public:
+    static constexpr uint32_t VERSION = 6;
+
+    bool load(const std::string& cachePath, const std::string& sourcePath, const MeshLayout& layout,
+        const MeshBuildSettings& settings);
+    void close();
+    bool isLoaded() const { return m_File.isOpen(); }
+    const MeshView& getView() const { return m_View; }
+
+    // Writes through a temporary file and renames it over cachePath. Returns
+    // false when the cache could not be written; the caller keeps going.
+    static bool store(const std::string& cachePath, const std::string& sourcePath,
+        const MeshLayout& layout, const MeshBuildSettings& settings, const MeshView& mesh);
+
+    static MeshBounds computeBounds(const void* vertices, uint64_t vertexCount, uint32_t stride, uint32_t positionOffset);
+
+private:
+    MappedFile m_File;
+    MeshView m_View;
+};
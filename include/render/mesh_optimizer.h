@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct VertexCacheStats {
+    // cache misses per triangle, 0.5 is the best a regular grid can reach
+    float acmr = 0.0f;
+    // cache misses per vertex, 1.0 means every vertex is shaded once
+    float atvr = 0.0f;
+};
+
+// Reorders indexed triangle lists after welding. The passes run in order:
+// vertex cache, then optionally overdraw, then vertex fetch.
+class MeshOptimizer {
+public:
+    static constexpr uint32_t CACHE_SIZE = 16;
+
+    // Tipsify (Sander, Nehab, Barczak 2007): fans around a vertex, then moves
+    // to the neighbour that is still in cache and has the fewest triangles
+    // left, falling back to recently emitted vertices at dead ends. Linear time.
+    static void optimizeVertexCache(std::vector<uint32_t>& vecIndices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+    // Cuts a cache-optimized list into clusters where the simulated cache
+    // restarts, then draws clusters that face away from the mesh center first
+    // so they occlude the inner ones. The order inside a cluster is kept, so
+    // ACMR barely moves. positionStride is in bytes.
+    static void optimizeOverdraw(std::vector<uint32_t>& vecIndices, const float* positions, uint32_t positionStride,
+        size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+    // Renumbers vertices in order of first use and moves their bytes to
+    // match. Unreferenced vertices are dropped; returns the new vertex count.
+    static size_t optimizeVertexFetch(std::vector<uint32_t>& vecIndices, void* vertices, uint32_t stride, size_t vertexCount);
+
+    // Simulates a FIFO post-transform cache.
+    static VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& vecIndices, size_t vertexCount,
+        uint32_t cacheSize = CACHE_SIZE);
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Quadric error metric simplification by half-edge collapse (Garland and
+// Heckbert 1997). A vertex only ever moves onto a neighbour, so every level
+// indexes the original vertex buffer and LODs share it.
+//
+// Vertices with equal positions are treated as one, so UV seams collapse
+// along the seam and stay closed. Open borders only collapse along the border
+// and non-manifold vertices never move. Collapses that would flip a triangle
+// are rejected.
+class MeshSimplifier {
+public:
+    // Returns the indices of a simplified mesh with at most targetIndexCount
+    // indices, or as close as the rules above allow. error receives the
+    // largest root mean square distance in object space between a moved vertex
+    // and the planes it absorbed, relative to vecIndices.
+    static std::vector<uint32_t> simplify(const std::vector<uint32_t>& vecIndices, const float* positions,
+        uint32_t positionStride, size_t vertexCount, size_t targetIndexCount, float& error);
+};
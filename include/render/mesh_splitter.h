@@ -0,0 +1,27 @@
+#pragma once
+
+#include "render/mesh_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Turns a 32-bit indexed triangle list into 16-bit index buffers. A mesh that
+// addresses at most MAX_VERTICES vertices is narrowed in place; a larger one is
+// cut into submeshes that each do, drawn with their own vertexOffset.
+class MeshSplitter {
+public:
+    static constexpr size_t MAX_VERTICES = 65536;
+
+    static bool fitsUint16(size_t vertexCount) { return vertexCount <= MAX_VERTICES; }
+
+    static void narrowIndices(const std::vector<uint32_t>& vecIndices, std::vector<uint16_t>& vecIndices16);
+
+    // Walks the triangles in order and starts a new submesh whenever the next
+    // triangle would push the current one past maxVertices. Vertices shared
+    // across a seam are duplicated; each submesh's vertices are written in
+    // first-use order. stride is the vertex size in bytes.
+    static void split(const void* vertices, uint32_t stride, const std::vector<uint32_t>& vecIndices,
+        std::vector<uint8_t>& vecVertices, std::vector<uint16_t>& vecIndices16,
+        std::vector<SubMesh>& vecSubMeshes, size_t maxVertices = MAX_VERTICES);
+};
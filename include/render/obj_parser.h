@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Same meaning as tinyobj::index_t, -1 when the corner has no such attribute.
+struct ObjIndex {
+    int vertex = -1;
+    int texcoord = -1;
+    int normal = -1;
+};
+
+// Triangulated OBJ geometry laid out like tinyobj's attrib_t plus the
+// concatenated mesh indices of every shape.
+struct ObjMesh {
+    std::vector<float> vertices;
+    std::vector<float> texcoords;
+    std::vector<float> normals;
+    // three per triangle, in file order
+    std::vector<ObjIndex> indices;
+};
+
+// Parses the v/vt/vn/f subset of OBJ on several threads. The file is cut at
+// line boundaries, every chunk is parsed independently and the streams are
+// stitched back in order, so the result matches tinyobj::LoadObj with its
+// default triangulation exactly. Polygons with more than four corners and
+// indices tinyobj rejects are not handled: parse() returns false and the
+// caller is expected to fall back to tinyobj.
+class ObjParser {
+public:
+    // threadCount 0 uses every hardware thread.
+    static bool parseFile(const std::string& path, ObjMesh& mesh, uint32_t threadCount = 0);
+    static bool parse(const char* data, size_t size, ObjMesh& mesh, uint32_t threadCount = 0);
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "render/job_system.h"
+
+// Runs func(i) for every i in [0, count) on up to threadCount threads, handing
+// out indices one at a time. Runs inline when one thread is enough, as jobs
+// when a JobSystem is running and on threads of its own otherwise.
+template <typename Func>
+void parallelFor(size_t count, uint32_t threadCount, Func func)
+{
+    if (threadCount <= 1 || count <= 1) {
+        for (size_t i = 0; i < count; ++i) func(i);
+        return;
+    }
+
+    if (JobSystem* pJobs = JobSystem::getActive()) {
+        pJobs->parallelFor(count, threadCount, func);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> vecThreads;
+    uint32_t workers = static_cast<uint32_t>(std::min<size_t>(threadCount, count));
+    for (uint32_t t = 0; t < workers; ++t) {
+        vecThreads.emplace_back([&]() {
+            for (size_t i = next++; i < count; i = next++) func(i);
+        });
+    }
+    for (auto& thread : vecThreads) thread.join();
+}
+
+inline uint32_t defaultThreadCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
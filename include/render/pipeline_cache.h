@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <string>
+
+// vk::PipelineCache seeded from the file an earlier run saved. Data written
+// by another driver or device is dropped before it reaches the driver, so a
+// stale file only costs one cold compile.
+class PipelineCache {
+public:
+    void init(vk::PhysicalDevice physicalDevice, vk::Device device, const std::string& path);
+    // Writes the current contents back through writeFileAtomic, then destroys the cache.
+    void destroy();
+
+    vk::PipelineCache get() const { return m_Cache; }
+
+private:
+    bool isCompatible(const uint8_t* pData, size_t size) const;
+
+    vk::Device m_Device;
+    vk::PhysicalDeviceProperties m_Properties;
+    std::string m_Path;
+    vk::PipelineCache m_Cache;
+};
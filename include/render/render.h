@@ -13,6 +13,26 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include "render/frame_timer.h"
+#include "render/gpu_profiler.h"
+#include "render/pipeline_cache.h"
+#include "render/device_allocator.h"
+#include "render/uniform_ring.h"
+#include "render/instance_buffer.h"
+#include "render/gpu_culler.h"
+#include "render/scene_objects.h"
+#include "render/upload_manager.h"
+#include "render/obj_parser.h"
+#include "render/vertex_dedup.h"
+#include "render/parallel_for.h"
+#include "render/job_system.h"
+#include "render/mesh_cache.h"
+#include "render/mesh_splitter.h"
+#include "render/mesh_optimizer.h"
+#include "render/mesh_simplifier.h"
+#include "render/texture_cache.h"
+#include "render/block_encoder.h"
+
 #include <array>
 #include <optional>
 #include <iostream>
@@ -20,9 +40,6 @@
 #include <cstdint>
 #include <stdexcept>
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
-
 struct Vertex{
     glm::vec3 pos;
     glm::vec3 color;
@@ -64,15 +81,45 @@ struct Vertex{
     }
 };
 
-namespace std{
-    template<> struct hash<Vertex> {
-        size_t operator()(const Vertex& vertex) const {
-            return ((hash<glm::vec3>()(vertex.pos) ^
-                    (hash<glm::vec3>()(vertex.color) << 1) >> 1) ^
-                    (hash<glm::vec2>()(vertex.texCoord) << 1));
-        }
-    };
-}
+// 12-byte layout quantized against the mesh: snorm16 position over the bounds,
+// unorm16 UV over the UV range and no color. The uniform block carries the
+// terms that decode them back.
+struct CompactVertex{
+    // w pads to a 16-bit format every device can fetch
+    int16_t pos[4];
+    uint16_t texCoord[2];
+
+    static vk::VertexInputBindingDescription getBindingDescription() {
+        vk::VertexInputBindingDescription bindingDescription{};
+
+        bindingDescription.setBinding(0)
+            .setStride(sizeof(CompactVertex))
+            .setInputRate(vk::VertexInputRate::eVertex);
+
+        return bindingDescription;
+    }
+
+    static std::array<vk::VertexInputAttributeDescription, 2> getAttributeDescriptions() {
+        std::array<vk::VertexInputAttributeDescription, 2> attributeDescriptions{};
+
+        attributeDescriptions[0].setBinding(0)
+            .setLocation(0)
+            .setFormat(vk::Format::eR16G16B16A16Snorm)
+            .setOffset(offsetof(CompactVertex, pos));
+
+        attributeDescriptions[1].setBinding(0)
+            .setLocation(2)
+            .setFormat(vk::Format::eR16G16Unorm)
+            .setOffset(offsetof(CompactVertex, texCoord));
+
+        return attributeDescriptions;
+    }
+};
+
+enum class VertexFormat {
+    eFloat,
+    eCompact,
+};
 
 static std::vector<char> readFile(const std::string& filename) {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -95,7 +142,20 @@ static std::vector<char> readFile(const std::string& filename) {
 class HelloTriangleApplication {
 public:
     bool m_FramebufferResized = false;
+    // benchmark only: the window toggles size every this many frames, 0 never
+    uint32_t m_ResizeInterval = 0;
 private:
+    // headless mode renders into offscreen images instead of a swapchain
+    bool m_Headless = false;
+    uint32_t m_LastRenderedImage = 0;
+
+    FrameTimer m_FrameTimer;
+    // asset loading, mips, culling and recording all go through parallelFor onto this
+    JobSystem m_Jobs;
+    GpuProfiler m_GpuProfiler;
+    uint32_t m_MainPassScope = 0;
+    uint32_t m_CullPassScope = 0;
+
     // GLFW members
     GLFWwindow *m_pWindow{ nullptr };
     const uint32_t m_Width = 600;
@@ -103,6 +163,24 @@ private:
 
     const std::string MODEL_PATH = "./src/models/viking_room/viking_room.obj";
     const std::string TEXTURE_PATH = "./src/models/viking_room/viking_room.png";
+    // written after the first import, later launches map it instead of parsing MODEL_PATH
+    const std::string MESH_CACHE_PATH = "./src/models/viking_room/viking_room.meshcache";
+    // mip chain baked from TEXTURE_PATH, same lifecycle as the mesh cache
+    const std::string TEXTURE_CACHE_PATH = "./src/models/viking_room/viking_room.texcache";
+    // driver pipeline cache, saved on shutdown and dropped when the device or driver changes
+    const std::string PIPELINE_CACHE_PATH = "./src/shaders/pipeline.cache";
+    // eFloat uploads Vertex as is, eCompact quantizes it into CompactVertex
+    const VertexFormat VERTEX_FORMAT = VertexFormat::eCompact;
+    // meshes over 65536 vertices become several 16-bit submeshes instead of keeping 32-bit indices
+    const bool SPLIT_LARGE_MESHES = true;
+    // after the vertex cache pass, draw outward-facing triangle clusters first
+    const bool OPTIMIZE_OVERDRAW = true;
+    // full mesh plus up to four levels, each with about half the triangles of the previous
+    const uint32_t LOD_LEVEL_COUNT = 5;
+    // a coarser level is drawn once its error covers at most this many pixels, checked per instance by cull.comp
+    const float LOD_PIXEL_ERROR = 1.0f;
+    // instance buffer slots, raised to the stress count when that is larger
+    const uint32_t MIN_INSTANCE_CAPACITY = 1024;
 
     // vulkan members
     const std::vector<const char *> m_vecValidationLayers = {
@@ -117,12 +195,20 @@ private:
     const bool m_EnableValidationLayers = true;
 #endif
     const int MAX_FRAMES_IN_FLIGHT = 2;
+    // uniform ring capacity per frame in flight
+    const vk::DeviceSize UNIFORM_RING_FRAME_SIZE = 64 * 1024;
+    // upper bound on host-visible memory used for uploads
+    const vk::DeviceSize STAGING_RING_SIZE = 16 * 1024 * 1024;
     uint32_t m_CurrentFrame = 0;
 
     // struct
     struct QueueFamilyIndices{ 
         std::optional<uint32_t> graphicsFamily; 
         std::optional<uint32_t> presentFamily;
+        // transfer-only family for async uploads, empty when there is none
+        std::optional<uint32_t> transferFamily;
+        // minImageTransferGranularity of transferFamily; (0,0,0) only allows whole mip levels
+        vk::Extent3D transferImageGranularity{ 1, 1, 1 };
 
         bool isComplete() { return graphicsFamily.has_value() && presentFamily.has_value(); }    
     };
@@ -136,6 +222,10 @@ private:
         glm::mat4 model;
         glm::mat4 view;
         glm::mat4 proj;  
+        // MeshDequantize terms, the texCoord one packs scale in xy and offset in zw
+        glm::vec4 positionScale;
+        glm::vec4 positionOffset;
+        glm::vec4 texCoordTransform;
     };
 
     vk::DebugUtilsMessengerEXT m_DebugMessenger;
@@ -143,19 +233,25 @@ private:
     vk::Instance m_Instance;
     vk::PhysicalDevice m_PhysicalDevice;
     vk::Device m_Device;
+    DeviceAllocator m_Allocator;
 
     vk::Queue m_GraphicsQueue;
     vk::Queue m_PresentQueue;
+    vk::Queue m_TransferQueue;
+
+    UploadManager m_UploadManager;
 
     vk::SurfaceKHR m_Surface;
 
     vk::SwapchainKHR m_SwapChain;
     std::vector<vk::Image> m_vecSwapChainImages;
     std::vector<vk::ImageView> m_vecSwapChainImageViews;
+    std::vector<MemoryAllocation> m_vecOffscreenImagesMemory;
     vk::Format m_SwapChainImageFormat;
     vk::Extent2D m_SwapChainExtent;
     vk::RenderPass m_RenderPass;
     vk::DescriptorSetLayout m_DescriptorSetLayout;
+    PipelineCache m_PipelineCache;
     vk::PipelineLayout m_PipelineLayout;
 
     vk::Pipeline m_GraphicsPipeline;
@@ -164,51 +260,114 @@ private:
     vk::CommandPool m_CommandPool;
 
     std::vector<vk::CommandBuffer> m_vecCommandBuffers;
+    // 0 records on every core, fixed once the pools exist
+    uint32_t m_RecordThreadCount = 0;
+    // a pool and a secondary per recording thread per frame in flight, indexed
+    // frame * m_RecordThreadCount + thread
+    std::vector<vk::CommandPool> m_vecSecondaryCommandPools;
+    std::vector<vk::CommandBuffer> m_vecSecondaryCommandBuffers;
+    // secondaries each frame recorded last time, only their pools need a reset
+    std::vector<uint32_t> m_vecRecordedJobCounts;
     
     std::vector<vk::Semaphore> m_vecImageAvailableSemaphores;
     std::vector<vk::Semaphore> m_vecRenderFinishedSemaphores;
     std::vector<vk::Fence> m_vecInFlightFences;
 
     std::vector<Vertex> m_Vertices;
+    std::vector<CompactVertex> m_vecCompactVertices;
     std::vector<uint32_t> m_Indices;
+    // 16-bit index path, split vertices are only filled for meshes over 65536 vertices
+    std::vector<uint16_t> m_vecIndices16;
+    std::vector<uint8_t> m_vecSplitVertices;
+    MeshCache m_MeshCache;
+    TextureCache m_TextureCache;
+    // written by loadTexture, points into m_TextureCache or m_vecTexels until the upload is recorded
+    TextureView m_Texture;
+    std::vector<uint8_t> m_vecTexels;
+    // points into m_MeshCache or m_Vertices/m_Indices until the upload is recorded
+    MeshView m_Mesh;
     vk::Buffer m_VertexBuffer;
-    vk::DeviceMemory m_VertexBufferMemory;
+    MemoryAllocation m_VertexBufferMemory;
     vk::Buffer m_IndexBuffer;
-    vk::DeviceMemory m_IndexBufferMemory;
-
-    std::vector<vk::Buffer> m_vecUniformBuffers;
-    std::vector<vk::DeviceMemory> m_vecUniformBuffersMemory;
+    MemoryAllocation m_IndexBufferMemory;
+
+    vk::Buffer m_UniformBuffer;
+    MemoryAllocation m_UniformBufferMemory;
+    UniformRing m_UniformRing;
+    uint32_t m_UniformDynamicOffset = 0;
+
+    vk::Buffer m_InstanceBuffer;
+    MemoryAllocation m_InstanceBufferMemory;
+    InstanceBuffer m_Instances;
+    uint32_t m_InstanceDynamicOffset = 0;
+    // 0 draws the model once, otherwise a grid of this many copies
+    uint32_t m_StressInstanceCount = 0;
+    GpuCuller m_GpuCuller;
+    uint32_t m_CullUniformOffset = 0;
+
+    // CPU culling works on whole objects before m_GpuCuller sees their instances
+    SceneObjects m_SceneObjects;
+    SceneObjects::Handle m_ModelObject = 0;
+    std::vector<SceneObjects::Handle> m_vecVisibleObjects;
+    // object space box around every instance of the mesh, removals never shrink it
+    glm::vec3 m_InstanceBoundsMin{ 0.0f };
+    glm::vec3 m_InstanceBoundsMax{ 0.0f };
+    bool m_InstanceBoundsEmpty = true;
 
     vk::DescriptorPool m_DescriptorPool;
     std::vector<vk::DescriptorSet> m_vecDescriptorSets;
 
     uint32_t m_MipLevels;
+    vk::Format m_TextureFormat = vk::Format::eR8G8B8A8Srgb;
     vk::Image m_TextureImage;
-    vk::DeviceMemory m_TextureImageMemory;
+    MemoryAllocation m_TextureImageMemory;
     vk::ImageView m_TextureImageView;
     vk::Sampler m_TextureSampler;
     vk::SampleCountFlagBits m_MSAASamples = vk::SampleCountFlagBits::e1;
 
     vk::Image m_ColorImage;
-    vk::DeviceMemory m_ColorImageMemory;
+    MemoryAllocation m_ColorImageMemory;
     vk::ImageView m_ColorImageView;
 
     vk::Image m_DepthImage;
-    vk::DeviceMemory m_DepthImageMemory;
+    MemoryAllocation m_DepthImageMemory;
     vk::ImageView m_DepthImageView;
 
 public:
     void run();
+    // Throws when readbackPath is set and frameCount is 0.
+    void runHeadless(uint32_t frameCount, const std::string& readbackPath = "");
+    void runBenchmark(uint32_t frameCount, uint32_t warmupFrames, bool headless);
+
+    const FrameTimer& getFrameTimer() const { return m_FrameTimer; }
+    std::vector<GpuProfiler::Stats> getGpuTimings() const { return m_GpuProfiler.getAllStats(); }
+    std::vector<DeviceAllocator::HeapStats> getMemoryStats() const { return m_Allocator.getHeapStats(); }
+
+    // Call before run*(): replaces the single model with count copies.
+    void setStressInstanceCount(uint32_t count) { m_StressInstanceCount = count; }
+    // Call before run*(): threads recording secondary command buffers, 0 for one per core.
+    void setRecordThreadCount(uint32_t count) { m_RecordThreadCount = count; }
+    // Call before runBenchmark(): windowed runs resize every interval frames to time recreateSwapChain.
+    void setResizeInterval(uint32_t interval) { m_ResizeInterval = interval; }
+
+    // Transforms apply in object space, before the global model matrix.
+    // Changes reach the GPU with the next frame. A handle that is not live throws.
+    InstanceBuffer::Handle addInstance(const glm::mat4& model) { InstanceBuffer::Handle handle = m_Instances.add(model); growInstanceBounds(model); return handle; }
+    void removeInstance(InstanceBuffer::Handle handle) { m_Instances.remove(handle); }
+    void updateInstance(InstanceBuffer::Handle handle, const glm::mat4& model) { m_Instances.update(handle, model); growInstanceBounds(model); }
 
 private:
     void initWindow();
     void initVulkan();
     void mainLoop();
+    void headlessLoop(uint32_t frameCount);
+    void benchmarkLoop(uint32_t frameCount, uint32_t warmupFrames);
     void cleanUp();
 
     // vulkan functions
     bool checkValidationLayerSupport();
     std::vector<const char *> getRequiredExtensions();
+    std::vector<const char *> getRequiredDeviceExtensions();
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
         VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
         VkDebugUtilsMessageTypeFlagsEXT messageTypes,
@@ -229,25 +388,24 @@ private:
 
     vk::ShaderModule createShaderModule(const std::vector<char>& code);
     void recordCommandBuffer(vk::CommandBuffer, uint32_t imageIndex);
+    uint32_t recordDrawCommands(uint32_t imageIndex, bool modelVisible);
 
-    uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags propertyFlags);
+    uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags propertyFlags, MemoryUsage memoryUsage);
 
     void createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage,
-                    vk::MemoryPropertyFlags properties, vk::Buffer& buffer, vk::DeviceMemory& bufferMemory);
-    void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size);
+                    vk::MemoryPropertyFlags properties, MemoryUsage memoryUsage,
+                    vk::Buffer& buffer, MemoryAllocation& bufferMemory);
     void updateUniformBuffer(uint32_t currentImage);
 
     void createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
         vk::SampleCountFlagBits numSamples, vk::Format format, vk::ImageTiling tiling,
-        vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, 
-        vk::Image& image, vk::DeviceMemory& memory);
+        vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, MemoryUsage memoryUsage,
+        vk::Image& image, MemoryAllocation& memory);
 
     vk::CommandBuffer beginSingleTimeCommands();
     void endSingleTimeCommands(vk::CommandBuffer commandBuffer);
-    void transitionImageLayout(vk::Image image, vk::Format format,
+    void transitionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, vk::Format format,
         vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t mipLevels);
-    
-    void copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height);
 
     vk::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels);
     
@@ -255,7 +413,6 @@ private:
     vk::Format findDepthFormat();
     bool hasStencilComponent(vk::Format format);
 
-    void generateMipmaps(vk::Image image, vk::Format format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 
     vk::SampleCountFlagBits getMaxUsableSampleCount();
 
@@ -264,30 +421,48 @@ private:
     void createSurface();
     void pickPhysicalDevice();
     void createLogicalDevice();
+    void createPipelineCache();
+    void createAllocator();
     void createSwapChain();
+    void createOffscreenTarget();
     void createImageViews();
     void createRenderPass();
     void createDescriptorSetLayout();
     void createGraphicsPipeline();
     void createFramebuffers();
     void createCommandPool();
+    void createUploadManager();
     void createColorResources();
     void createDepthResources();
+    void loadTexture();
     void createTextureImage();
     void createTextureImageView();
     void createTextureSampler();
     void loadModel();
+    void optimizeMesh();
+    void buildLodChain();
+    void quantizeVertices();
+    void buildIndexBuffer16(uint32_t vertexStride);
+    MeshLayout getMeshLayout() const;
+    void releaseMeshData();
     void createVertexBuffer();
     void createIndexBuffer();
     void createUniformBuffers();
+    void createInstanceBuffer();
+    void growInstanceBounds(const glm::mat4& model);
+    void createGpuCuller();
     void createDescriptorPool();
     void createDescriptorSets();
     void createCommandBuffers();
     void createSyncObjects();
+    void createQueryPools();
 
     void recreateSwapChain();
+    void cleanupSwapChainTargets();
     void cleanupSwapChain();
 
     // render functions
     void drawFrame();
+    void drawOffscreenFrame();
+    void saveOffscreenImage(const std::string& path);
 };
\ No newline at end of file
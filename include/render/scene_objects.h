@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "render/frustum.h"
+
+#include <cstdint>
+#include <vector>
+
+// World space bounding boxes of scene objects, kept as separate arrays per
+// component so cull() can test 4 (SSE) or 8 (AVX) boxes per instruction.
+// Objects stay densely packed; removing one moves the last into its slot.
+class SceneObjects {
+public:
+    using Handle = uint32_t;
+
+    // below this many objects cull() stays on the calling thread
+    static constexpr uint32_t PARALLEL_CULL_THRESHOLD = 16384;
+    // objects per job when culling on several threads, a multiple of every lane count
+    static constexpr uint32_t CULL_BLOCK_SIZE = 4096;
+
+    Handle add(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    // remove and update throw on a handle that is not live
+    void remove(Handle handle);
+    void update(Handle handle, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    void clear();
+
+    // Replaces vecVisible with the handles of the boxes touching the frustum,
+    // in slot order.
+    void cull(const Frustum& frustum, std::vector<Handle>& vecVisible, uint32_t threadCount);
+    // Same result one box at a time, the reference for tests and benchmarks.
+    void cullScalar(const Frustum& frustum, std::vector<Handle>& vecVisible) const;
+
+    uint32_t getCount() const { return static_cast<uint32_t>(m_vecHandleOfSlot.size()); }
+    // name of the instruction set cull() was built with
+    static const char* getSimdName();
+
+private:
+    // frustum planes split into the terms of the box test
+    struct CullPlanes {
+        float normal[6][3];
+        float absNormal[6][3];
+        float distance[6];
+    };
+
+    static CullPlanes buildCullPlanes(const Frustum& frustum);
+    uint32_t slotOf(Handle handle) const;
+    void store(uint32_t slot, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    bool touchesFrustum(const CullPlanes& planes, uint32_t slot) const;
+    void cullRange(const Frustum& frustum, uint32_t begin, uint32_t end, std::vector<Handle>& vecVisible) const;
+
+    // box center and half extents, padded to a whole number of SIMD lanes
+    std::vector<float> m_vecCenterX;
+    std::vector<float> m_vecCenterY;
+    std::vector<float> m_vecCenterZ;
+    std::vector<float> m_vecExtentX;
+    std::vector<float> m_vecExtentY;
+    std::vector<float> m_vecExtentZ;
+
+    // handles stay valid while slots move; freed handles are reused and map to INVALID_SLOT
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+    std::vector<uint32_t> m_vecSlotOfHandle;
+    std::vector<Handle> m_vecHandleOfSlot;
+    std::vector<Handle> m_vecFreeHandles;
+    // per job results when culling on several threads
+    std::vector<std::vector<Handle>> m_vecBlockVisible;
+};
+
+// Box around an object space box after an affine transform.
+void transformBounds(const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+    glm::vec3& outMin, glm::vec3& outMax);
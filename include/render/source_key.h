@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Identifies the version of a source asset a cache was built from. Size and
+// mtime are cheap to read. The content hash is computed when a cache is
+// written, and again only when the mtime moved but the size did not, so a
+// touched or re-checked-out file still hits its cache.
+struct SourceKey {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t contentHash = 0;
+
+    // Reads all three fields, hashing the whole file.
+    static bool compute(const std::string& path, SourceKey& key);
+    // True when cached still describes the file at path.
+    static bool matches(const SourceKey& cached, const std::string& path);
+    static uint64_t hashFile(const std::string& path);
+};
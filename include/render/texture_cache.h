@@ -0,0 +1,49 @@
+#pragma once
+
+#include "render/mapped_file.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One mip level inside a texel blob; offsets are 16-byte aligned.
+struct TextureLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Non-owning view of a texture with its full mip chain.
+struct TextureView {
+    // a VkFormat value
+    uint32_t format = 0;
+    const uint8_t* pData = nullptr;
+    uint64_t dataSize = 0;
+    std::vector<TextureLevel> levels;
+};
+
+// Texture container holding every mip level pre-generated, written after the
+// first decode of a source image and keyed on its SourceKey. Warm starts map
+// it and upload the levels as they are, with no image decode and no blit chain.
+class TextureCache {
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    bool load(const std::string& cachePath, const std::string& sourcePath, uint32_t format);
+    void close();
+    bool isLoaded() const { return m_File.isOpen(); }
+    const TextureView& getView() const { return m_View; }
+
+    static bool store(const std::string& cachePath, const std::string& sourcePath, const TextureView& texture);
+
+    // Box filters 8-bit RGBA down to 1x1. Color channels are averaged in linear
+    // space when srgb is set, alpha always is. Fills vecLevels and returns the texels.
+    // Bands of rows of each level are filtered on up to threadCount threads.
+    static std::vector<uint8_t> buildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height,
+        bool srgb, std::vector<TextureLevel>& vecLevels, uint32_t threadCount = 1);
+
+private:
+    MappedFile m_File;
+    TextureView m_View;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+
+// One persistently mapped uniform buffer split into a region per frame in
+// flight. Each push() sub-allocates an aligned slot in the current frame's
+// region and returns it as a dynamic offset for eUniformBufferDynamic bindings.
+class UniformRing {
+public:
+    void init(vk::Buffer buffer, void* pMapped, vk::DeviceSize frameSize, uint32_t frameCount, vk::DeviceSize alignment);
+
+    static vk::DeviceSize alignSize(vk::DeviceSize size, vk::DeviceSize alignment);
+
+    // Only call once the frame's fence has signalled, the region is reused.
+    void beginFrame(uint32_t frame);
+    uint32_t push(const void* data, vk::DeviceSize size);
+
+    vk::Buffer getBuffer() const { return m_Buffer; }
+    vk::DeviceSize getFrameSize() const { return m_FrameSize; }
+    vk::DeviceSize getUsedBytes() const { return m_Cursor; }
+
+private:
+    vk::Buffer m_Buffer;
+    uint8_t* m_pMapped = nullptr;
+    vk::DeviceSize m_FrameSize = 0;
+    vk::DeviceSize m_Alignment = 1;
+    uint32_t m_FrameCount = 0;
+
+    vk::DeviceSize m_FrameBase = 0;
+    vk::DeviceSize m_Cursor = 0;
+};
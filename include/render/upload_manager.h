@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include "render/device_allocator.h"
+#include "render/texture_cache.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <vector>
+
+// Batches staging copies onto a dedicated transfer queue when the device has
+// one and hands the resources over to the graphics queue with queue family
+// ownership transfers. Completion is tracked per batch with a fence, so
+// nothing waits for a queue to go idle. Images only take the transfer queue
+// when its family copies at texel granularity; otherwise they are copied on
+// the graphics queue, which always can.
+//
+// Staging goes through one persistently mapped ring. Uploads larger than a
+// chunk are split, and a chunk that needs space still owned by an earlier
+// batch waits for that batch's fence, so host-visible usage never exceeds
+// the ring size.
+class UploadManager {
+public:
+    using Ticket = uint64_t;
+    using GraphicsCommands = std::function<void(vk::CommandBuffer)>;
+
+    static constexpr vk::DeviceSize DEFAULT_STAGING_SIZE = 16ull * 1024 * 1024;
+
+    void init(vk::Device device, DeviceAllocator* pAllocator,
+        uint32_t graphicsFamily, vk::Queue graphicsQueue,
+        std::optional<uint32_t> transferFamily, vk::Queue transferQueue, vk::Extent3D transferImageGranularity,
+        vk::DeviceSize stagingSize = DEFAULT_STAGING_SIZE);
+    void destroy();
+
+    bool hasDedicatedTransferQueue() const { return m_TransferFamily != m_GraphicsFamily; }
+
+    // Copies data into dst at dstOffset, visible to dstStage/dstAccess on the graphics queue.
+    void uploadBuffer(vk::Buffer dst, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset,
+        vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess);
+    // Fills every mip level of a color image from levels laid out in data.
+    // Levels that fit one staging chunk together go out as one copy with a
+    // region per level. The image ends in eShaderReadOnlyOptimal on graphics.
+    // blockExtent is the texel height of one block row (4 for BC formats).
+    void uploadImage(vk::Image image, const void* data, const std::vector<TextureLevel>& levels,
+        uint32_t blockExtent = 1);
+    // Records graphics-only work (layout transitions) into the next submission.
+    void recordGraphics(GraphicsCommands commands);
+
+    // Submits everything recorded since the last flush.
+    Ticket flush();
+    // Retires finished batches and releases their staging memory.
+    void poll();
+    bool isComplete(Ticket ticket);
+    void wait(Ticket ticket);
+
+    vk::DeviceSize getStagingSize() const { return m_StagingSize; }
+    vk::DeviceSize getStagingInUse() const { return m_StagingInUse; }
+
+private:
+    struct Batch {
+        Ticket ticket = 0;
+        vk::CommandBuffer transferCommandBuffer;
+        vk::CommandBuffer graphicsCommandBuffer;
+        vk::Semaphore ownershipSemaphore;
+        vk::Fence fence;
+        // ring bytes owned by this batch (padding included) and where they end
+        vk::DeviceSize stagingBytes = 0;
+        vk::DeviceSize stagingEnd = 0;
+        std::vector<GraphicsCommands> vecGraphicsCommands;
+        std::vector<vk::BufferMemoryBarrier> vecBufferAcquires;
+        std::vector<vk::ImageMemoryBarrier> vecImageAcquires;
+        vk::PipelineStageFlags acquireStages;
+    };
+
+    Batch& currentBatch();
+    // Records now on the transfer queue, or on the graphics queue at flush when images go there.
+    void recordImageCommands(GraphicsCommands commands);
+    // Copies data into the ring and returns its offset, waiting for space if needed.
+    vk::DeviceSize stage(const void* data, vk::DeviceSize size);
+    // Copies one level that is larger than a chunk, a band of block rows at a time.
+    void stageImageRows(vk::Image image, const uint8_t* pSrc, const TextureLevel& level, uint32_t mipLevel,
+        uint32_t blockExtent);
+    static vk::BufferImageCopy imageCopyRegion(vk::DeviceSize bufferOffset, uint32_t mipLevel,
+        uint32_t row, uint32_t width, uint32_t rows);
+    void retire(Batch& batch);
+
+    vk::Device m_Device;
+    DeviceAllocator* m_pAllocator = nullptr;
+
+    uint32_t m_GraphicsFamily = 0;
+    uint32_t m_TransferFamily = 0;
+    bool m_ImagesOnGraphicsQueue = false;
+    vk::Queue m_GraphicsQueue;
+    vk::Queue m_TransferQueue;
+    vk::CommandPool m_GraphicsCommandPool;
+    vk::CommandPool m_TransferCommandPool;
+
+    vk::Buffer m_StagingBuffer;
+    MemoryAllocation m_StagingMemory;
+    uint8_t* m_pStaging = nullptr;
+    vk::DeviceSize m_StagingSize = 0;
+    vk::DeviceSize m_StagingChunkSize = 0;
+    vk::DeviceSize m_StagingHead = 0;
+    vk::DeviceSize m_StagingTail = 0;
+    vk::DeviceSize m_StagingInUse = 0;
+
+    std::optional<Batch> m_RecordingBatch;
+    std::deque<Batch> m_InFlightBatches;
+    Ticket m_NextTicket = 1;
+    Ticket m_CompletedTicket = 0;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Welds identical vertices stored as fixed-size runs of floats. Components are
+// compared as floats, like Vertex::operator==, and hashed over their bit
+// pattern with -0.0 folded into 0.0 so equal vertices always share a hash.
+//
+// The table uses open addressing with linear probing and keeps the low hash
+// bits next to each slot to skip most float compares. Capacity is reserved up
+// front from the vertex count, so a weld never allocates per vertex.
+class VertexDedup {
+public:
+    // Writes one index per input vertex into vecIndices and, in order of first
+    // appearance, the input position of every unique vertex into
+    // vecFirstOccurrences. threadCount > 1 shards the vertices by hash across
+    // threads; the result is identical to the single-threaded one.
+    static void weld(const float* data, uint32_t floatsPerVertex, size_t vertexCount,
+        std::vector<uint32_t>& vecIndices, std::vector<uint32_t>& vecFirstOccurrences,
+        uint32_t threadCount = 1);
+
+    static uint64_t hashVertex(const float* vertex, uint32_t floatsPerVertex);
+};
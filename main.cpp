@@ -1,16 +1,38 @@
 #include "render/render.h"
 #include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <string>
 
 int main(int argc, char *argv[]) {
     HelloTriangleApplication app;
     std::cout << argv[0] << std::endl;
+
+    // --headless [frames] [--readback <file.ppm>] [--instances N]
+    bool headless = false;
+    uint32_t frameCount = 100;
+    std::string readbackPath;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--readback") == 0 && i + 1 < argc) {
+            readbackPath = argv[++i];
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            app.setStressInstanceCount(static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+    }
+
     try {
-        app.run();
+        if (headless)
+            app.runHeadless(frameCount, readbackPath);
+        else
+            app.run();
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,504 @@
+#include "render/block_encoder.h"
+#include "render/parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// AVX needs LEARNVK_AVX (-mavx or /arch:AVX), SSE2 is part of every x86-64 target
+#if defined(__AVX__)
+#include <immintrin.h>
+#define BLOCK_ENCODER_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCK_ENCODER_SSE
+#endif
+
+namespace {
+    constexpr uint32_t TEXELS = 16;
+    constexpr uint64_t LEVEL_ALIGNMENT = 16;
+
+    // BC7 4-bit index weights, out of 64
+    constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // channel-major so the per-texel loops work on contiguous floats
+    struct BlockTexels {
+        float channels[4][TEXELS];
+    };
+
+    struct Endpoints {
+        float a[4];
+        float b[4];
+    };
+
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+    }
+
+    BlockTexels loadTexels(const uint8_t* pTexels)
+    {
+        BlockTexels block;
+        for (uint32_t i = 0; i < TEXELS; ++i)
+            for (uint32_t c = 0; c < 4; ++c)
+                block.channels[c][i] = pTexels[i * 4 + c];
+        return block;
+    }
+
+    // Endpoints at the extremes of the texels projected on their principal axis.
+    Endpoints fitPrincipalAxis(const BlockTexels& block, uint32_t channelCount)
+    {
+        float mean[4] = {};
+        float axis[4] = {};
+        for (uint32_t c = 0; c < channelCount; ++c) {
+            float sum = 0.0f, low = 255.0f, high = 0.0f;
+            for (uint32_t i = 0; i < TEXELS; ++i) {
+                sum += block.channels[c][i];
+                low = std::min(low, block.channels[c][i]);
+                high = std::max(high, block.channels[c][i]);
+            }
+            mean[c] = sum / TEXELS;
+            axis[c] = high - low;
+        }
+
+        float covariance[4][4] = {};
+        for (uint32_t c0 = 0; c0 < channelCount; ++c0) {
+            for (uint32_t c1 = c0; c1 < channelCount; ++c1) {
+                float sum = 0.0f;
+                for (uint32_t i = 0; i < TEXELS; ++i)
+                    sum += (block.channels[c0][i] - mean[c0]) * (block.channels[c1][i] - mean[c1]);
+                covariance[c0][c1] = covariance[c1][c0] = sum;
+            }
+        }
+
+        // a few power iterations from the bounding box diagonal are enough for 16 points
+        for (int iteration = 0; iteration < 4; ++iteration) {
+            float next[4] = {};
+            float length = 0.0f;
+            for (uint32_t c0 = 0; c0 < channelCount; ++c0) {
+                for (uint32_t c1 = 0; c1 < channelCount; ++c1)
+                    next[c0] += covariance[c0][c1] * axis[c1];
+                length = std::max(length, std::fabs(next[c0]));
+            }
+            if (length < 1e-6f) break;
+            for (uint32_t c = 0; c < channelCount; ++c) axis[c] = next[c] / length;
+        }
+
+        float lengthSquared = 0.0f;
+        for (uint32_t c = 0; c < channelCount; ++c) lengthSquared += axis[c] * axis[c];
+
+        Endpoints endpoints{};
+        if (lengthSquared < 1e-12f) {
+            for (uint32_t c = 0; c < channelCount; ++c) endpoints.a[c] = endpoints.b[c] = mean[c];
+            return endpoints;
+        }
+
+        float low = 0.0f, high = 0.0f;
+        for (uint32_t i = 0; i < TEXELS; ++i) {
+            float t = 0.0f;
+            for (uint32_t c = 0; c < channelCount; ++c) t += (block.channels[c][i] - mean[c]) * axis[c];
+            low = std::min(low, t);
+            high = std::max(high, t);
+        }
+        low /= lengthSquared;
+        high /= lengthSquared;
+        for (uint32_t c = 0; c < channelCount; ++c) {
+            endpoints.a[c] = std::clamp(mean[c] + axis[c] * low, 0.0f, 255.0f);
+            endpoints.b[c] = std::clamp(mean[c] + axis[c] * high, 0.0f, 255.0f);
+        }
+        return endpoints;
+    }
+
+    // Solves for the endpoints that best reproduce the block with the given
+    // blend weights (0 is endpoint a, 1 is endpoint b). Returns false when the
+    // weights do not pin both endpoints down.
+    bool refineEndpoints(const BlockTexels& block, uint32_t channelCount, const float* weights, Endpoints& endpoints)
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[4] = {}, bx[4] = {};
+        for (uint32_t i = 0; i < TEXELS; ++i) {
+            float wb = weights[i];
+            float wa = 1.0f - wb;
+            aa += wa * wa;
+            ab += wa * wb;
+            bb += wb * wb;
+            for (uint32_t c = 0; c < channelCount; ++c) {
+                ax[c] += wa * block.channels[c][i];
+                bx[c] += wb * block.channels[c][i];
+            }
+        }
+
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-6f) return false;
+        for (uint32_t c = 0; c < channelCount; ++c) {
+            endpoints.a[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+            endpoints.b[c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+        }
+        return true;
+    }
+
+    // Picks the nearest palette entry for every texel, returns the summed squared error.
+    // The vector paths add the channels in the same order, so all of them pick the same indices.
+    template <uint32_t PaletteSize>
+    float selectIndices(const BlockTexels& block, uint32_t channelCount, const float (&palette)[PaletteSize][4], uint8_t* indices)
+    {
+        float bestError[TEXELS];
+#if defined(BLOCK_ENCODER_AVX)
+        const uint32_t LANES = 8;
+        __m256 best[TEXELS / LANES], bestIndex[TEXELS / LANES];
+        for (uint32_t v = 0; v < TEXELS / LANES; ++v) {
+            best[v] = _mm256_set1_ps(1e30f);
+            bestIndex[v] = _mm256_setzero_ps();
+        }
+        for (uint32_t entry = 0; entry < PaletteSize; ++entry) {
+            __m256 color[4];
+            for (uint32_t c = 0; c < channelCount; ++c) color[c] = _mm256_set1_ps(palette[entry][c]);
+            // the index rides along as raw int bits, blends never touch them as floats
+            __m256 index = _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(entry)));
+            for (uint32_t v = 0; v < TEXELS / LANES; ++v) {
+                __m256 error = _mm256_setzero_ps();
+                for (uint32_t c = 0; c < channelCount; ++c) {
+                    __m256 delta = _mm256_sub_ps(_mm256_loadu_ps(&block.channels[c][v * LANES]), color[c]);
+                    error = _mm256_add_ps(error, _mm256_mul_ps(delta, delta));
+                }
+                __m256 closer = _mm256_cmp_ps(error, best[v], _CMP_LT_OQ);
+                best[v] = _mm256_blendv_ps(best[v], error, closer);
+                bestIndex[v] = _mm256_blendv_ps(bestIndex[v], index, closer);
+            }
+        }
+        int32_t bestEntry[TEXELS];
+        for (uint32_t v = 0; v < TEXELS / LANES; ++v) {
+            _mm256_storeu_ps(&bestError[v * LANES], best[v]);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&bestEntry[v * LANES]), _mm256_castps_si256(bestIndex[v]));
+        }
+        for (uint32_t i = 0; i < TEXELS; ++i) indices[i] = static_cast<uint8_t>(bestEntry[i]);
+#elif defined(BLOCK_ENCODER_SSE)
+        const uint32_t LANES = 4;
+        __m128 best[TEXELS / LANES], bestIndex[TEXELS / LANES];
+        for (uint32_t v = 0; v < TEXELS / LANES; ++v) {
+            best[v] = _mm_set1_ps(1e30f);
+            bestIndex[v] = _mm_setzero_ps();
+        }
+        for (uint32_t entry = 0; entry < PaletteSize; ++entry) {
+            __m128 color[4];
+            for (uint32_t c = 0; c < channelCount; ++c) color[c] = _mm_set1_ps(palette[entry][c]);
+            __m128 index = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(entry)));
+            for (uint32_t v = 0; v < TEXELS / LANES; ++v) {
+                __m128 error = _mm_setzero_ps();
+                for (uint32_t c = 0; c < channelCount; ++c) {
+                    __m128 delta = _mm_sub_ps(_mm_loadu_ps(&block.channels[c][v * LANES]), color[c]);
+                    error = _mm_add_ps(error, _mm_mul_ps(delta, delta));
+                }
+                // SSE2 has no blend, select with and/andnot
+                __m128 closer = _mm_cmplt_ps(error, best[v]);
+                best[v] = _mm_or_ps(_mm_and_ps(closer, error), _mm_andnot_ps(closer, best[v]));
+                bestIndex[v] = _mm_or_ps(_mm_and_ps(closer, index), _mm_andnot_ps(closer, bestIndex[v]));
+            }
+        }
+        int32_t bestEntry[TEXELS];
+        for (uint32_t v = 0; v < TEXELS / LANES; ++v) {
+            _mm_storeu_ps(&bestError[v * LANES], best[v]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&bestEntry[v * LANES]), _mm_castps_si128(bestIndex[v]));
+        }
+        for (uint32_t i = 0; i < TEXELS; ++i) indices[i] = static_cast<uint8_t>(bestEntry[i]);
+#else
+        std::fill(bestError, bestError + TEXELS, 1e30f);
+        for (uint32_t entry = 0; entry < PaletteSize; ++entry) {
+            float error[TEXELS] = {};
+            for (uint32_t c = 0; c < channelCount; ++c) {
+                for (uint32_t i = 0; i < TEXELS; ++i) {
+                    float delta = block.channels[c][i] - palette[entry][c];
+                    error[i] += delta * delta;
+                }
+            }
+            for (uint32_t i = 0; i < TEXELS; ++i) {
+                if (error[i] < bestError[i]) {
+                    bestError[i] = error[i];
+                    indices[i] = static_cast<uint8_t>(entry);
+                }
+            }
+        }
+#endif
+
+        float total = 0.0f;
+        for (uint32_t i = 0; i < TEXELS; ++i) total += bestError[i];
+        return total;
+    }
+
+    // --- BC1 color ---
+
+    uint16_t packRgb565(const float* color)
+    {
+        auto quantize = [](float value, int maxValue) {
+            return static_cast<uint16_t>(std::clamp(static_cast<int>(value * maxValue / 255.0f + 0.5f), 0, maxValue));
+        };
+        return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+    }
+
+    void unpackRgb565(uint16_t packed, float* color)
+    {
+        uint32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = static_cast<float>((r << 3) | (r >> 2));
+        color[1] = static_cast<float>((g << 2) | (g >> 4));
+        color[2] = static_cast<float>((b << 3) | (b >> 2));
+    }
+
+    struct ColorBlock {
+        uint16_t color0;
+        uint16_t color1;
+        uint8_t indices[TEXELS];
+        float error;
+    };
+
+    // index 0 and 1 are the endpoints, 2 and 3 sit a third and two thirds toward color1
+    constexpr float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+    ColorBlock quantizeColorBlock(const BlockTexels& block, const Endpoints& endpoints)
+    {
+        ColorBlock result{};
+        result.color0 = packRgb565(endpoints.a);
+        result.color1 = packRgb565(endpoints.b);
+        // color0 > color1 selects the four-color mode
+        if (result.color0 < result.color1) std::swap(result.color0, result.color1);
+
+        float palette[4][4] = {};
+        unpackRgb565(result.color0, palette[0]);
+        unpackRgb565(result.color1, palette[1]);
+        for (uint32_t c = 0; c < 3; ++c) {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+
+        // equal endpoints decode in three-color mode, index 0 is still exact
+        if (result.color0 == result.color1) {
+            float flat[1][4] = { { palette[0][0], palette[0][1], palette[0][2], 0.0f } };
+            result.error = selectIndices(block, 3, flat, result.indices);
+            return result;
+        }
+
+        result.error = selectIndices(block, 3, palette, result.indices);
+        return result;
+    }
+
+    void encodeColorBlock(const BlockTexels& block, uint8_t* pBlock)
+    {
+        Endpoints endpoints = fitPrincipalAxis(block, 3);
+        ColorBlock best = quantizeColorBlock(block, endpoints);
+
+        float weights[TEXELS];
+        for (uint32_t i = 0; i < TEXELS; ++i) weights[i] = BC1_WEIGHTS[best.indices[i]];
+        if (best.color0 != best.color1 && refineEndpoints(block, 3, weights, endpoints)) {
+            ColorBlock refined = quantizeColorBlock(block, endpoints);
+            if (refined.error < best.error) best = refined;
+        }
+
+        uint32_t packedIndices = 0;
+        for (uint32_t i = 0; i < TEXELS; ++i) packedIndices |= uint32_t(best.indices[i]) << (2 * i);
+        memcpy(pBlock, &best.color0, 2);
+        memcpy(pBlock + 2, &best.color1, 2);
+        memcpy(pBlock + 4, &packedIndices, 4);
+    }
+
+    // --- BC3 alpha ---
+
+    void encodeAlphaBlock(const BlockTexels& block, uint8_t* pBlock)
+    {
+        float low = 255.0f, high = 0.0f;
+        for (uint32_t i = 0; i < TEXELS; ++i) {
+            low = std::min(low, block.channels[3][i]);
+            high = std::max(high, block.channels[3][i]);
+        }
+
+        uint8_t alpha0 = static_cast<uint8_t>(high);
+        uint8_t alpha1 = static_cast<uint8_t>(low);
+        uint64_t packedIndices = 0;
+        if (alpha0 != alpha1) {
+            // alpha0 > alpha1 selects the eight-value mode
+            float palette[8][4] = {};
+            palette[0][0] = alpha0;
+            palette[1][0] = alpha1;
+            for (uint32_t entry = 2; entry < 8; ++entry)
+                palette[entry][0] = static_cast<float>(((8 - entry) * alpha0 + (entry - 1) * alpha1) / 7);
+
+            // match on channel 0 only, so move alpha there
+            BlockTexels alphaOnly{};
+            std::copy(block.channels[3], block.channels[3] + TEXELS, alphaOnly.channels[0]);
+
+            uint8_t indices[TEXELS];
+            selectIndices(alphaOnly, 1, palette, indices);
+            for (uint32_t i = 0; i < TEXELS; ++i) packedIndices |= uint64_t(indices[i]) << (3 * i);
+        }
+
+        pBlock[0] = alpha0;
+        pBlock[1] = alpha1;
+        for (uint32_t byte = 0; byte < 6; ++byte) pBlock[2 + byte] = static_cast<uint8_t>(packedIndices >> (8 * byte));
+    }
+
+    // --- BC7 mode 6 ---
+
+    struct Bc7Endpoint {
+        int values[4];
+        int pBit;
+    };
+
+    // 7 bits per channel plus a p-bit shared by the four channels of one endpoint
+    Bc7Endpoint quantizeBc7Endpoint(const float* color)
+    {
+        Bc7Endpoint best{};
+        float bestError = 1e30f;
+        for (int pBit = 0; pBit < 2; ++pBit) {
+            Bc7Endpoint candidate{};
+            candidate.pBit = pBit;
+            float error = 0.0f;
+            for (uint32_t c = 0; c < 4; ++c) {
+                candidate.values[c] = std::clamp(static_cast<int>((color[c] - pBit) / 2.0f + 0.5f), 0, 127);
+                float delta = static_cast<float>((candidate.values[c] << 1) | pBit) - color[c];
+                error += delta * delta;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = candidate;
+            }
+        }
+        return best;
+    }
+
+    struct Bc7Block {
+        Bc7Endpoint endpoint0;
+        Bc7Endpoint endpoint1;
+        uint8_t indices[TEXELS];
+        float error;
+    };
+
+    Bc7Block quantizeBc7Block(const BlockTexels& block, const Endpoints& endpoints)
+    {
+        Bc7Block result{};
+        result.endpoint0 = quantizeBc7Endpoint(endpoints.a);
+        result.endpoint1 = quantizeBc7Endpoint(endpoints.b);
+
+        float palette[16][4];
+        for (uint32_t entry = 0; entry < 16; ++entry) {
+            for (uint32_t c = 0; c < 4; ++c) {
+                int e0 = (result.endpoint0.values[c] << 1) | result.endpoint0.pBit;
+                int e1 = (result.endpoint1.values[c] << 1) | result.endpoint1.pBit;
+                palette[entry][c] = static_cast<float>(((64 - BC7_WEIGHTS[entry]) * e0 + BC7_WEIGHTS[entry] * e1 + 32) >> 6);
+            }
+        }
+        result.error = selectIndices(block, 4, palette, result.indices);
+        return result;
+    }
+
+    class BitWriter {
+    public:
+        explicit BitWriter(uint8_t* pBlock) : m_pBlock(pBlock) { memset(pBlock, 0, 16); }
+
+        void write(uint32_t value, uint32_t bitCount)
+        {
+            for (uint32_t bit = 0; bit < bitCount; ++bit, ++m_Position)
+                m_pBlock[m_Position / 8] |= ((value >> bit) & 1) << (m_Position % 8);
+        }
+
+    private:
+        uint8_t* m_pBlock;
+        uint32_t m_Position = 0;
+    };
+
+    void encodeBc7Block(const BlockTexels& block, uint8_t* pBlock)
+    {
+        Endpoints endpoints = fitPrincipalAxis(block, 4);
+        Bc7Block best = quantizeBc7Block(block, endpoints);
+
+        float weights[TEXELS];
+        for (uint32_t i = 0; i < TEXELS; ++i) weights[i] = BC7_WEIGHTS[best.indices[i]] / 64.0f;
+        if (refineEndpoints(block, 4, weights, endpoints)) {
+            Bc7Block refined = quantizeBc7Block(block, endpoints);
+            if (refined.error < best.error) best = refined;
+        }
+
+        // the first index is stored without its top bit, so it has to be below 8
+        if (best.indices[0] & 8) {
+            std::swap(best.endpoint0, best.endpoint1);
+            for (uint32_t i = 0; i < TEXELS; ++i) best.indices[i] = static_cast<uint8_t>(15 - best.indices[i]);
+        }
+
+        BitWriter writer(pBlock);
+        writer.write(1 << 6, 7);
+        for (uint32_t c = 0; c < 4; ++c) {
+            writer.write(best.endpoint0.values[c], 7);
+            writer.write(best.endpoint1.values[c], 7);
+        }
+        writer.write(best.endpoint0.pBit, 1);
+        writer.write(best.endpoint1.pBit, 1);
+        writer.write(best.indices[0], 3);
+        for (uint32_t i = 1; i < TEXELS; ++i) writer.write(best.indices[i], 4);
+    }
+}
+
+uint32_t BlockEncoder::getBlockBytes(BlockFormat format)
+{
+    return format == BlockFormat::eBC1 ? 8 : 16;
+}
+
+void BlockEncoder::encodeBlock(BlockFormat format, const uint8_t* pTexels, uint8_t* pBlock)
+{
+    BlockTexels block = loadTexels(pTexels);
+    switch (format) {
+    case BlockFormat::eBC1:
+        encodeColorBlock(block, pBlock);
+        break;
+    case BlockFormat::eBC3:
+        encodeAlphaBlock(block, pBlock);
+        encodeColorBlock(block, pBlock + 8);
+        break;
+    case BlockFormat::eBC7:
+        encodeBc7Block(block, pBlock);
+        break;
+    }
+}
+
+std::vector<uint8_t> BlockEncoder::encodeMipChain(BlockFormat format, const uint8_t* pTexels,
+    const std::vector<TextureLevel>& vecSourceLevels, std::vector<TextureLevel>& vecLevels,
+    uint32_t threadCount)
+{
+    uint32_t blockBytes = getBlockBytes(format);
+
+    struct BlockRow {
+        uint32_t level;
+        uint32_t row;
+    };
+    std::vector<BlockRow> vecRows;
+
+    vecLevels.clear();
+    uint64_t offset = 0;
+    for (uint32_t level = 0; level < vecSourceLevels.size(); ++level) {
+        const TextureLevel& source = vecSourceLevels[level];
+        uint32_t blocksX = (source.width + BLOCK_EXTENT - 1) / BLOCK_EXTENT;
+        uint32_t blocksY = (source.height + BLOCK_EXTENT - 1) / BLOCK_EXTENT;
+        vecLevels.push_back({ source.width, source.height, offset, uint64_t(blocksX) * blocksY * blockBytes });
+        offset = alignOffset(offset + vecLevels.back().size);
+        for (uint32_t row = 0; row < blocksY; ++row) vecRows.push_back({ level, row });
+    }
+
+    std::vector<uint8_t> vecBlocks(offset, 0);
+    parallelFor(vecRows.size(), threadCount, [&](size_t job) {
+        const TextureLevel& source = vecSourceLevels[vecRows[job].level];
+        const TextureLevel& target = vecLevels[vecRows[job].level];
+        const uint8_t* pSource = pTexels + source.offset;
+        uint32_t blocksX = (source.width + BLOCK_EXTENT - 1) / BLOCK_EXTENT;
+        uint8_t* pOut = vecBlocks.data() + target.offset + uint64_t(vecRows[job].row) * blocksX * blockBytes;
+
+        uint8_t texels[TEXELS * 4];
+        for (uint32_t blockX = 0; blockX < blocksX; ++blockX) {
+            for (uint32_t y = 0; y < BLOCK_EXTENT; ++y) {
+                uint32_t sourceY = std::min(vecRows[job].row * BLOCK_EXTENT + y, source.height - 1);
+                for (uint32_t x = 0; x < BLOCK_EXTENT; ++x) {
+                    uint32_t sourceX = std::min(blockX * BLOCK_EXTENT + x, source.width - 1);
+                    memcpy(&texels[(y * BLOCK_EXTENT + x) * 4], pSource + (size_t(sourceY) * source.width + sourceX) * 4, 4);
+                }
+            }
+            encodeBlock(format, texels, pOut + blockX * blockBytes);
+        }
+    });
+
+    return vecBlocks;
+}
@@ -0,0 +1,249 @@
+#include "render/device_allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+struct FreeRange {
+    vk::DeviceSize offset;
+    vk::DeviceSize size;
+};
+
+struct MemoryBlock {
+    vk::DeviceMemory memory;
+    vk::DeviceSize size = 0;
+    uint8_t* pMapped = nullptr;
+    uint32_t poolIndex = 0;
+    uint32_t allocationCount = 0;
+    vk::DeviceSize usedBytes = 0;
+    std::vector<FreeRange> freeRanges;  // sorted by offset, never adjacent
+};
+
+static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+DeviceAllocator::DeviceAllocator() = default;
+DeviceAllocator::~DeviceAllocator() = default;
+
+void DeviceAllocator::init(vk::PhysicalDevice physicalDevice, vk::Device device, vk::DeviceSize blockSize)
+{
+    m_Device = device;
+    m_BlockSize = blockSize;
+    m_MemoryTypeSelector.init(physicalDevice);
+    m_MemoryProperties = m_MemoryTypeSelector.getProperties();
+
+    vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+    m_BufferImageGranularity = std::max<vk::DeviceSize>(limits.bufferImageGranularity, 1);
+    m_MaxDeviceMemoryCount = limits.maxMemoryAllocationCount;
+
+    // with a granularity of 1 linear and optimal resources may share blocks
+    uint32_t kindCount = m_BufferImageGranularity > 1 ? 2 : 1;
+    m_vecPools.resize(m_MemoryProperties.memoryTypeCount * kindCount);
+    for (uint32_t i = 0; i < m_vecPools.size(); ++i)
+        m_vecPools[i].memoryTypeIndex = i / kindCount;
+}
+
+void DeviceAllocator::destroy()
+{
+    for (auto& pool : m_vecPools) {
+        for (auto& block : pool.blocks)
+            freeDeviceMemory(block->memory);
+        pool.blocks.clear();
+    }
+    for (auto& allocation : m_vecDedicated)
+        freeDeviceMemory(allocation.memory);
+    m_vecDedicated.clear();
+}
+
+vk::DeviceSize DeviceAllocator::blockSizeForType(uint32_t memoryTypeIndex) const
+{
+    // small heaps (e.g. 256 MiB BAR windows) get proportionally smaller blocks
+    uint32_t heapIndex = m_MemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    vk::DeviceSize heapSize = m_MemoryProperties.memoryHeaps[heapIndex].size;
+    return std::max<vk::DeviceSize>(std::min(m_BlockSize, heapSize / 8), 1ull << 20);
+}
+
+vk::DeviceMemory DeviceAllocator::allocateDeviceMemory(vk::DeviceSize size, uint32_t memoryTypeIndex, void** ppMapped)
+{
+    if (m_MaxDeviceMemoryCount != 0 && m_DeviceMemoryCount >= m_MaxDeviceMemoryCount)
+        throw std::runtime_error("exceeded maxMemoryAllocationCount!");
+
+    vk::MemoryAllocateInfo allocInfo{};
+    allocInfo.setAllocationSize(size)
+        .setMemoryTypeIndex(memoryTypeIndex);
+
+    vk::DeviceMemory memory = m_Device.allocateMemory(allocInfo);
+    if (!memory) throw std::runtime_error("failed to allocate device memory!");
+    ++m_DeviceMemoryCount;
+
+    *ppMapped = nullptr;
+    if (m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        *ppMapped = m_Device.mapMemory(memory, 0, VK_WHOLE_SIZE);
+
+    return memory;
+}
+
+void DeviceAllocator::freeDeviceMemory(vk::DeviceMemory memory)
+{
+    // freeing implicitly unmaps
+    m_Device.freeMemory(memory);
+    --m_DeviceMemoryCount;
+}
+
+MemoryAllocation DeviceAllocator::allocate(const vk::MemoryRequirements& requirements, uint32_t memoryTypeIndex, ResourceKind kind)
+{
+    vk::DeviceSize blockSize = blockSizeForType(memoryTypeIndex);
+
+    bool dedicated = requirements.size > blockSize / 2 ||
+        (kind == ResourceKind::eOptimal && requirements.size >= DEDICATED_IMAGE_THRESHOLD);
+    if (dedicated) {
+        MemoryAllocation allocation{};
+        allocation.memory = allocateDeviceMemory(requirements.size, memoryTypeIndex, &allocation.pMapped);
+        allocation.size = requirements.size;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        m_vecDedicated.push_back(allocation);
+        return allocation;
+    }
+
+    uint32_t kindCount = static_cast<uint32_t>(m_vecPools.size() / m_MemoryProperties.memoryTypeCount);
+    uint32_t poolIndex = memoryTypeIndex * kindCount + (kindCount > 1 && kind == ResourceKind::eOptimal ? 1 : 0);
+    Pool& pool = m_vecPools[poolIndex];
+
+    // best fit across every block of the pool
+    MemoryBlock* pBestBlock = nullptr;
+    size_t bestRange = 0;
+    vk::DeviceSize bestWaste = ~0ull;
+    for (auto& block : pool.blocks) {
+        for (size_t i = 0; i < block->freeRanges.size(); ++i) {
+            const FreeRange& range = block->freeRanges[i];
+            vk::DeviceSize alignedOffset = alignUp(range.offset, requirements.alignment);
+            vk::DeviceSize padding = alignedOffset - range.offset;
+            if (range.size < padding + requirements.size) continue;
+
+            vk::DeviceSize waste = range.size - padding - requirements.size;
+            if (waste < bestWaste) {
+                pBestBlock = block.get();
+                bestRange = i;
+                bestWaste = waste;
+            }
+        }
+    }
+
+    if (!pBestBlock) {
+        auto block = std::make_unique<MemoryBlock>();
+        void* pMapped = nullptr;
+        block->memory = allocateDeviceMemory(blockSize, memoryTypeIndex, &pMapped);
+        block->pMapped = static_cast<uint8_t*>(pMapped);
+        block->size = blockSize;
+        block->poolIndex = poolIndex;
+        block->freeRanges.push_back({ 0, blockSize });
+
+        pBestBlock = block.get();
+        bestRange = 0;
+        pool.blocks.push_back(std::move(block));
+    }
+
+    FreeRange range = pBestBlock->freeRanges[bestRange];
+    vk::DeviceSize alignedOffset = alignUp(range.offset, requirements.alignment);
+    vk::DeviceSize end = alignedOffset + requirements.size;
+
+    // split the range, alignment padding in front stays on the free list
+    auto& freeRanges = pBestBlock->freeRanges;
+    freeRanges.erase(freeRanges.begin() + bestRange);
+    if (end < range.offset + range.size)
+        freeRanges.insert(freeRanges.begin() + bestRange, { end, range.offset + range.size - end });
+    if (alignedOffset > range.offset)
+        freeRanges.insert(freeRanges.begin() + bestRange, { range.offset, alignedOffset - range.offset });
+
+    pBestBlock->usedBytes += requirements.size;
+    ++pBestBlock->allocationCount;
+
+    MemoryAllocation allocation{};
+    allocation.memory = pBestBlock->memory;
+    allocation.offset = alignedOffset;
+    allocation.size = requirements.size;
+    allocation.pMapped = pBestBlock->pMapped ? pBestBlock->pMapped + alignedOffset : nullptr;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.pBlock = pBestBlock;
+
+    return allocation;
+}
+
+void DeviceAllocator::free(MemoryAllocation& allocation)
+{
+    if (!allocation) return;
+
+    if (!allocation.pBlock) {
+        auto it = std::find_if(m_vecDedicated.begin(), m_vecDedicated.end(),
+            [&allocation](const MemoryAllocation& a) { return a.memory == allocation.memory; });
+        if (it != m_vecDedicated.end()) m_vecDedicated.erase(it);
+        freeDeviceMemory(allocation.memory);
+        allocation = MemoryAllocation{};
+        return;
+    }
+
+    MemoryBlock* pBlock = allocation.pBlock;
+    auto& freeRanges = pBlock->freeRanges;
+
+    FreeRange freed{ allocation.offset, allocation.size };
+    auto it = std::lower_bound(freeRanges.begin(), freeRanges.end(), freed.offset,
+        [](const FreeRange& r, vk::DeviceSize offset) { return r.offset < offset; });
+
+    // coalesce with the neighbours on either side
+    if (it != freeRanges.end() && freed.offset + freed.size == it->offset) {
+        freed.size += it->size;
+        it = freeRanges.erase(it);
+    }
+    if (it != freeRanges.begin() && std::prev(it)->offset + std::prev(it)->size == freed.offset) {
+        std::prev(it)->size += freed.size;
+    } else {
+        freeRanges.insert(it, freed);
+    }
+
+    pBlock->usedBytes -= allocation.size;
+    --pBlock->allocationCount;
+
+    // keep one empty block around per pool so resizes do not thrash
+    Pool& pool = m_vecPools[pBlock->poolIndex];
+    if (pBlock->allocationCount == 0 && pool.blocks.size() > 1) {
+        freeDeviceMemory(pBlock->memory);
+        pool.blocks.erase(std::find_if(pool.blocks.begin(), pool.blocks.end(),
+            [pBlock](const std::unique_ptr<MemoryBlock>& b) { return b.get() == pBlock; }));
+    }
+
+    allocation = MemoryAllocation{};
+}
+
+std::vector<DeviceAllocator::HeapStats> DeviceAllocator::getHeapStats() const
+{
+    std::vector<HeapStats> stats(m_MemoryProperties.memoryHeapCount);
+
+    for (const auto& pool : m_vecPools) {
+        HeapStats& heap = stats[m_MemoryProperties.memoryTypes[pool.memoryTypeIndex].heapIndex];
+        for (const auto& block : pool.blocks) {
+            heap.reservedBytes += block->size;
+            heap.usedBytes += block->usedBytes;
+            heap.allocationCount += block->allocationCount;
+            ++heap.blockCount;
+            for (const auto& range : block->freeRanges) {
+                heap.freeBytes += range.size;
+                heap.largestFreeRange = std::max(heap.largestFreeRange, range.size);
+            }
+        }
+    }
+
+    for (const auto& allocation : m_vecDedicated) {
+        HeapStats& heap = stats[m_MemoryProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex];
+        heap.reservedBytes += allocation.size;
+        heap.usedBytes += allocation.size;
+        ++heap.allocationCount;
+        ++heap.dedicatedCount;
+    }
+
+    for (auto& heap : stats)
+        if (heap.freeBytes > 0)
+            heap.fragmentation = 1.0f - static_cast<float>(heap.largestFreeRange) / static_cast<float>(heap.freeBytes);
+
+    return stats;
+}
@@ -0,0 +1,81 @@
+#include "render/frame_timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+void FrameTimer::reserve(size_t frameCount) {
+    for (auto& samples : m_vecSamples)
+        samples.reserve(frameCount);
+}
+
+void FrameTimer::reset() {
+    for (auto& samples : m_vecSamples)
+        samples.clear();
+}
+
+void FrameTimer::record(Section section, double milliseconds) {
+    if (!m_Enabled) return;
+    m_vecSamples[section].push_back(milliseconds);
+}
+
+FrameTimer::Summary FrameTimer::summarize(Section section) const {
+    Summary summary{};
+    std::vector<double> sorted = m_vecSamples[section];
+    if (sorted.empty()) return summary;
+
+    std::sort(sorted.begin(), sorted.end());
+
+    // nearest-rank percentiles
+    auto percentile = [&sorted](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    };
+
+    summary.count = sorted.size();
+    summary.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+    summary.p50 = percentile(0.50);
+    summary.p95 = percentile(0.95);
+    summary.p99 = percentile(0.99);
+    summary.max = sorted.back();
+    return summary;
+}
+
+void FrameTimer::report(std::ostream& os) const {
+    os << std::left << std::setw(20) << "section (ms)"
+       << std::right << std::setw(8) << "count"
+       << std::setw(10) << "total"
+       << std::setw(10) << "mean"
+       << std::setw(10) << "p50"
+       << std::setw(10) << "p95"
+       << std::setw(10) << "p99"
+       << std::setw(10) << "max" << "\n";
+
+    os << std::fixed << std::setprecision(3);
+    for (uint32_t i = 0; i < eSectionCount; ++i) {
+        auto section = static_cast<Section>(i);
+        Summary summary = summarize(section);
+        os << std::left << std::setw(20) << sectionName(section)
+           << std::right << std::setw(8) << summary.count
+           << std::setw(10) << summary.mean * summary.count
+           << std::setw(10) << summary.mean
+           << std::setw(10) << summary.p50
+           << std::setw(10) << summary.p95
+           << std::setw(10) << summary.p99
+           << std::setw(10) << summary.max << "\n";
+    }
+    os << std::defaultfloat;
+}
+
+const char* FrameTimer::sectionName(Section section) {
+    switch (section) {
+    case eFrame: return "frame";
+    case eWaitForFences: return "waitForFences";
+    case eAcquireNextImage: return "acquireNextImageKHR";
+    case ePresent: return "presentKHR";
+    case eRecordCommands: return "recordCommands";
+    case eRecreateSwapChain: return "recreateSwapChain";
+    default: return "unknown";
+    }
+}
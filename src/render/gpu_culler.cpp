@@ -0,0 +1,308 @@
+#include "render/gpu_culler.h"
+#include "render/frustum.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    vk::DeviceSize alignSize(vk::DeviceSize size, vk::DeviceSize alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    float maxAxisScale(const glm::mat4& matrix)
+    {
+        return std::max({ glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])),
+            glm::length(glm::vec3(matrix[2])) });
+    }
+}
+
+void GpuCuller::init(vk::PhysicalDevice physicalDevice, vk::Device device, DeviceAllocator* pAllocator,
+    vk::PipelineCache pipelineCache, const std::vector<char>& shaderCode, const MeshView& mesh,
+    vk::Buffer uniformBuffer, vk::Buffer instanceBuffer, vk::DeviceSize instanceRange,
+    uint32_t instanceCapacity, uint32_t framesInFlight)
+{
+    m_Device = device;
+    m_pAllocator = pAllocator;
+
+    // createLogicalDevice enables both whenever they are supported
+    vk::PhysicalDeviceFeatures features = physicalDevice.getFeatures();
+    m_MultiDraw = features.multiDrawIndirect && features.drawIndirectFirstInstance;
+
+    const MeshBounds& bounds = mesh.bounds;
+    glm::vec3 boundsMin(bounds.min[0], bounds.min[1], bounds.min[2]);
+    glm::vec3 boundsMax(bounds.max[0], bounds.max[1], bounds.max[2]);
+    m_MeshSphere = glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
+
+    // a mesh without a LOD table is drawn as a single level
+    std::vector<MeshLod> vecLods = mesh.lods;
+    if (vecLods.empty())
+        vecLods.push_back({ 0.0f, 0, static_cast<uint32_t>(mesh.subMeshes.size()) });
+
+    m_vecLods.clear();
+    m_vecCommandLods.clear();
+    std::vector<vk::DrawIndexedIndirectCommand> vecCommands;
+    for (const MeshLod& lod : vecLods) {
+        uint32_t visibleBase = static_cast<uint32_t>(m_vecLods.size()) * instanceCapacity;
+        m_vecLods.push_back({ lod.error, static_cast<uint32_t>(vecCommands.size()), lod.subMeshCount, visibleBase });
+        for (uint32_t i = lod.firstSubMesh; i < lod.firstSubMesh + lod.subMeshCount; ++i) {
+            const SubMesh& subMesh = mesh.subMeshes[i];
+            vecCommands.push_back(vk::DrawIndexedIndirectCommand(subMesh.indexCount, 0, subMesh.firstIndex,
+                subMesh.vertexOffset, m_MultiDraw ? visibleBase : 0));
+            m_vecCommandLods.push_back(static_cast<uint32_t>(m_vecLods.size() - 1));
+        }
+    }
+    m_CommandCount = static_cast<uint32_t>(vecCommands.size());
+
+    // the tables are tiny and written once, they stay host visible
+    vk::DeviceSize storageAlignment = physicalDevice.getProperties().limits.minStorageBufferOffsetAlignment;
+    vk::DeviceSize commandsSize = vecCommands.size() * sizeof(vk::DrawIndexedIndirectCommand);
+    createBuffer(commandsSize, vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        MemoryUsage::eUpload, m_TemplateBuffer, m_TemplateMemory);
+    memcpy(m_TemplateMemory.pMapped, vecCommands.data(), commandsSize);
+
+    createBuffer(m_vecLods.size() * sizeof(GpuLod), vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        MemoryUsage::eUpload, m_LodBuffer, m_LodMemory);
+    memcpy(m_LodMemory.pMapped, m_vecLods.data(), m_vecLods.size() * sizeof(GpuLod));
+
+    // one region per frame in flight for what the pass writes
+    m_CommandFrameSize = alignSize(commandsSize, storageAlignment);
+    createBuffer(m_CommandFrameSize * framesInFlight,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryUsage::eGpuOnly, m_CommandBuffer, m_CommandMemory);
+
+    m_VisibleFrameSize = alignSize(uint64_t(m_vecLods.size()) * instanceCapacity * sizeof(uint32_t), storageAlignment);
+    createBuffer(m_VisibleFrameSize * framesInFlight, vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryUsage::eGpuOnly, m_VisibleBuffer, m_VisibleMemory);
+
+    createPipeline(pipelineCache, shaderCode);
+    createDescriptorSet(uniformBuffer, instanceBuffer, instanceRange);
+}
+
+void GpuCuller::destroy()
+{
+    m_Device.destroyPipeline(m_Pipeline);
+    m_Device.destroyPipelineLayout(m_PipelineLayout);
+    m_Device.destroyDescriptorPool(m_DescriptorPool);
+    m_Device.destroyDescriptorSetLayout(m_DescriptorSetLayout);
+
+    m_Device.destroyBuffer(m_VisibleBuffer);
+    m_pAllocator->free(m_VisibleMemory);
+    m_Device.destroyBuffer(m_CommandBuffer);
+    m_pAllocator->free(m_CommandMemory);
+    m_Device.destroyBuffer(m_LodBuffer);
+    m_pAllocator->free(m_LodMemory);
+    m_Device.destroyBuffer(m_TemplateBuffer);
+    m_pAllocator->free(m_TemplateMemory);
+}
+
+GpuCuller::Uniforms GpuCuller::buildUniforms(const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj,
+    float viewportHeight, float pixelError, uint32_t instanceCount) const
+{
+    // everything stays in the space instances are placed in, before the model matrix
+    Uniforms uniforms{};
+    Frustum frustum = Frustum::fromMatrix(proj * view * model);
+    std::copy(std::begin(frustum.planes), std::end(frustum.planes), uniforms.planes);
+
+    // the camera looks down -z in view space
+    glm::mat4 viewModel = view * model;
+    uniforms.depthPlane = -glm::vec4(viewModel[0][2], viewModel[1][2], viewModel[2][2], viewModel[3][2]);
+
+    float modelScale = maxAxisScale(model);
+    uniforms.meshSphere = m_MeshSphere;
+    uniforms.lodParams = glm::vec4(std::abs(proj[1][1]) * viewportHeight * 0.5f * modelScale, pixelError, modelScale, 0.0f);
+    uniforms.instanceCount = instanceCount;
+    uniforms.lodCount = static_cast<uint32_t>(m_vecLods.size());
+    return uniforms;
+}
+
+void GpuCuller::record(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t uniformOffset,
+    uint32_t instanceOffset, uint32_t instanceCount)
+{
+    vk::DeviceSize commandsOffset = m_CommandFrameSize * frame;
+    vk::DeviceSize commandsSize = m_CommandCount * sizeof(vk::DrawIndexedIndirectCommand);
+    commandBuffer.copyBuffer(m_TemplateBuffer, m_CommandBuffer, vk::BufferCopy(0, commandsOffset, commandsSize));
+
+    vk::BufferMemoryBarrier resetBarrier{};
+    resetBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setBuffer(m_CommandBuffer)
+        .setOffset(commandsOffset)
+        .setSize(commandsSize);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+        vk::DependencyFlags{}, nullptr, resetBarrier, nullptr);
+
+    std::array<uint32_t, 4> dynamicOffsets = { uniformOffset, instanceOffset,
+        static_cast<uint32_t>(commandsOffset), static_cast<uint32_t>(m_VisibleFrameSize * frame) };
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_Pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_PipelineLayout, 0, m_DescriptorSet, dynamicOffsets);
+    if (instanceCount > 0)
+        commandBuffer.dispatch((instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    std::array<vk::BufferMemoryBarrier, 2> cullBarriers{};
+    cullBarriers[0].setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setBuffer(m_CommandBuffer)
+        .setOffset(commandsOffset)
+        .setSize(commandsSize);
+    cullBarriers[1].setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setBuffer(m_VisibleBuffer)
+        .setOffset(m_VisibleFrameSize * frame)
+        .setSize(m_VisibleFrameSize);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader,
+        vk::DependencyFlags{}, nullptr, cullBarriers, nullptr);
+}
+
+void GpuCuller::draw(vk::CommandBuffer commandBuffer, uint32_t frame, vk::PipelineLayout layout,
+    uint32_t firstCommand, uint32_t commandCount)
+{
+    vk::DeviceSize commandsOffset = m_CommandFrameSize * frame;
+    uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+    if (commandCount == 0) return;
+
+    if (m_MultiDraw) {
+        uint32_t visibleBase = 0;
+        commandBuffer.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(visibleBase), &visibleBase);
+        commandBuffer.drawIndexedIndirect(m_CommandBuffer, commandsOffset + firstCommand * stride, commandCount, stride);
+        return;
+    }
+
+    for (uint32_t i = firstCommand; i < firstCommand + commandCount; ++i) {
+        uint32_t visibleBase = m_vecLods[m_vecCommandLods[i]].visibleBase;
+        commandBuffer.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(visibleBase), &visibleBase);
+        commandBuffer.drawIndexedIndirect(m_CommandBuffer, commandsOffset + i * stride, 1, stride);
+    }
+}
+
+void GpuCuller::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties,
+    MemoryUsage memoryUsage, vk::Buffer& buffer, MemoryAllocation& memory)
+{
+    vk::BufferCreateInfo bufferInfo{};
+    bufferInfo.setSize(size)
+        .setUsage(usage)
+        .setSharingMode(vk::SharingMode::eExclusive);
+    buffer = m_Device.createBuffer(bufferInfo);
+    if (!buffer) throw std::runtime_error("failed to create culling buffer!");
+
+    vk::MemoryRequirements memRequirements = m_Device.getBufferMemoryRequirements(buffer);
+    uint32_t memoryType = m_pAllocator->getMemoryTypeSelector().select(memRequirements.memoryTypeBits, properties, memoryUsage);
+    memory = m_pAllocator->allocate(memRequirements, memoryType, ResourceKind::eLinear);
+    if (!memory) throw std::runtime_error("failed to allocate culling buffer memory!");
+    m_Device.bindBufferMemory(buffer, memory.memory, memory.offset);
+}
+
+void GpuCuller::createPipeline(vk::PipelineCache pipelineCache, const std::vector<char>& shaderCode)
+{
+    std::array<vk::DescriptorSetLayoutBinding, 5> bindings{};
+    bindings[0].setBinding(0)
+        .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+        .setDescriptorCount(1)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    bindings[1].setBinding(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+        .setDescriptorCount(1)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    bindings[2].setBinding(2)
+        .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    bindings[3].setBinding(3)
+        .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+        .setDescriptorCount(1)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    bindings[4].setBinding(4)
+        .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+        .setDescriptorCount(1)
+        .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+
+    vk::DescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.setBindings(bindings);
+    m_DescriptorSetLayout = m_Device.createDescriptorSetLayout(layoutInfo);
+    if (!m_DescriptorSetLayout) throw std::runtime_error("failed to create culling descriptor set layout!");
+
+    vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.setSetLayouts(m_DescriptorSetLayout);
+    m_PipelineLayout = m_Device.createPipelineLayout(pipelineLayoutInfo);
+    if (!m_PipelineLayout) throw std::runtime_error("failed to create culling pipeline layout!");
+
+    vk::ShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.setCodeSize(shaderCode.size())
+        .setPCode(reinterpret_cast<const uint32_t*>(shaderCode.data()));
+    vk::ShaderModule shaderModule = m_Device.createShaderModule(moduleInfo);
+    if (!shaderModule) throw std::runtime_error("failed to create culling shader module!");
+
+    vk::PipelineShaderStageCreateInfo stageInfo{};
+    stageInfo.setStage(vk::ShaderStageFlagBits::eCompute)
+        .setModule(shaderModule)
+        .setPName("main");
+
+    vk::ComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.setStage(stageInfo)
+        .setLayout(m_PipelineLayout);
+    auto pipeline = m_Device.createComputePipeline(pipelineCache, pipelineInfo);
+    m_Device.destroy(shaderModule);
+    if (pipeline.result != vk::Result::eSuccess)
+        throw std::runtime_error("failed to create culling pipeline!");
+    m_Pipeline = pipeline.value;
+}
+
+void GpuCuller::createDescriptorSet(vk::Buffer uniformBuffer, vk::Buffer instanceBuffer, vk::DeviceSize instanceRange)
+{
+    std::array<vk::DescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].setType(vk::DescriptorType::eUniformBufferDynamic)
+        .setDescriptorCount(1);
+    poolSizes[1].setType(vk::DescriptorType::eStorageBufferDynamic)
+        .setDescriptorCount(3);
+    poolSizes[2].setType(vk::DescriptorType::eStorageBuffer)
+        .setDescriptorCount(1);
+
+    vk::DescriptorPoolCreateInfo poolInfo{};
+    poolInfo.setPoolSizes(poolSizes)
+        .setMaxSets(1);
+    m_DescriptorPool = m_Device.createDescriptorPool(poolInfo);
+    if (!m_DescriptorPool) throw std::runtime_error("failed to create culling descriptor pool!");
+
+    vk::DescriptorSetAllocateInfo allocInfo{};
+    allocInfo.setDescriptorPool(m_DescriptorPool)
+        .setSetLayouts(m_DescriptorSetLayout);
+    m_DescriptorSet = m_Device.allocateDescriptorSets(allocInfo).front();
+
+    // every frame uses the same set, its regions come from the dynamic offsets
+    std::array<vk::DescriptorBufferInfo, 5> bufferInfos = {
+        vk::DescriptorBufferInfo(uniformBuffer, 0, sizeof(Uniforms)),
+        vk::DescriptorBufferInfo(instanceBuffer, 0, instanceRange),
+        vk::DescriptorBufferInfo(m_LodBuffer, 0, m_vecLods.size() * sizeof(GpuLod)),
+        vk::DescriptorBufferInfo(m_CommandBuffer, 0, m_CommandCount * sizeof(vk::DrawIndexedIndirectCommand)),
+        vk::DescriptorBufferInfo(m_VisibleBuffer, 0, m_VisibleFrameSize),
+    };
+    std::array<vk::DescriptorType, 5> types = {
+        vk::DescriptorType::eUniformBufferDynamic,
+        vk::DescriptorType::eStorageBufferDynamic,
+        vk::DescriptorType::eStorageBuffer,
+        vk::DescriptorType::eStorageBufferDynamic,
+        vk::DescriptorType::eStorageBufferDynamic,
+    };
+
+    std::array<vk::WriteDescriptorSet, 5> descriptorWrites{};
+    for (uint32_t i = 0; i < descriptorWrites.size(); ++i)
+        descriptorWrites[i].setDstSet(m_DescriptorSet)
+            .setDstBinding(i)
+            .setDstArrayElement(0)
+            .setDescriptorType(types[i])
+            .setDescriptorCount(1)
+            .setPBufferInfo(&bufferInfos[i]);
+    m_Device.updateDescriptorSets(descriptorWrites, nullptr);
+}
@@ -0,0 +1,127 @@
+#include "render/gpu_profiler.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+void GpuProfiler::init(vk::PhysicalDevice physicalDevice, vk::Device device, uint32_t queueFamilyIndex, uint32_t framesInFlight)
+{
+    m_Device = device;
+
+    vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+    auto queueFamilies = physicalDevice.getQueueFamilyProperties();
+    uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+
+    m_Supported = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+    if (!m_Supported) return;
+
+    m_TimestampPeriodNs = properties.limits.timestampPeriod;
+    m_TimestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+    vk::QueryPoolCreateInfo poolInfo{};
+    poolInfo.setQueryType(vk::QueryType::eTimestamp)
+        .setQueryCount(MAX_SCOPES * 2);
+
+    m_vecQueryPools.resize(framesInFlight);
+    m_vecWrittenScopes.assign(framesInFlight, 0);
+    for (auto& queryPool : m_vecQueryPools) {
+        queryPool = m_Device.createQueryPool(poolInfo);
+        if (!queryPool) throw std::runtime_error("failed to create timestamp query pool!");
+    }
+}
+
+void GpuProfiler::destroy()
+{
+    for (auto& queryPool : m_vecQueryPools)
+        m_Device.destroyQueryPool(queryPool);
+    m_vecQueryPools.clear();
+    m_vecWrittenScopes.clear();
+}
+
+uint32_t GpuProfiler::registerScope(const std::string& name)
+{
+    if (m_vecScopes.size() >= MAX_SCOPES)
+        throw std::runtime_error("too many gpu profiler scopes!");
+
+    ScopeHistory history{};
+    history.name = name;
+    history.samples.resize(HISTORY_SIZE);
+    m_vecScopes.push_back(history);
+    return static_cast<uint32_t>(m_vecScopes.size() - 1);
+}
+
+void GpuProfiler::collect(uint32_t frame)
+{
+    if (!m_Supported) return;
+
+    uint32_t written = m_vecWrittenScopes[frame];
+    m_vecWrittenScopes[frame] = 0;
+
+    for (uint32_t scope = 0; written != 0; ++scope, written >>= 1) {
+        if (!(written & 1u)) continue;
+
+        // { begin, beginAvailable, end, endAvailable }
+        uint64_t data[4] = {};
+        vk::Result result = m_Device.getQueryPoolResults(m_vecQueryPools[frame], scope * 2, 2,
+            sizeof(data), data, sizeof(uint64_t) * 2,
+            vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+        if (result != vk::Result::eSuccess || data[1] == 0 || data[3] == 0) continue;
+
+        uint64_t ticks = ((data[2] & m_TimestampMask) - (data[0] & m_TimestampMask)) & m_TimestampMask;
+        double milliseconds = static_cast<double>(ticks) * m_TimestampPeriodNs * 1e-6;
+
+        ScopeHistory& history = m_vecScopes[scope];
+        history.samples[history.next] = milliseconds;
+        history.next = (history.next + 1) % HISTORY_SIZE;
+        history.count = std::min(history.count + 1, HISTORY_SIZE);
+    }
+}
+
+void GpuProfiler::beginFrame(vk::CommandBuffer commandBuffer, uint32_t frame)
+{
+    if (!m_Supported) return;
+    commandBuffer.resetQueryPool(m_vecQueryPools[frame], 0, MAX_SCOPES * 2);
+}
+
+void GpuProfiler::beginScope(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t scope)
+{
+    if (!m_Supported) return;
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_vecQueryPools[frame], scope * 2);
+}
+
+void GpuProfiler::endScope(vk::CommandBuffer commandBuffer, uint32_t frame, uint32_t scope)
+{
+    if (!m_Supported) return;
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_vecQueryPools[frame], scope * 2 + 1);
+    m_vecWrittenScopes[frame] |= 1u << scope;
+}
+
+GpuProfiler::Stats GpuProfiler::getStats(uint32_t scope) const
+{
+    const ScopeHistory& history = m_vecScopes[scope];
+
+    Stats stats{};
+    stats.name = history.name;
+    stats.sampleCount = history.count;
+    if (history.count == 0) return stats;
+
+    stats.lastMs = history.samples[(history.next + HISTORY_SIZE - 1) % HISTORY_SIZE];
+    stats.minMs = std::numeric_limits<double>::max();
+    double total = 0.0;
+    for (size_t i = 0; i < history.count; ++i) {
+        double sample = history.samples[i];
+        total += sample;
+        stats.minMs = std::min(stats.minMs, sample);
+        stats.maxMs = std::max(stats.maxMs, sample);
+    }
+    stats.avgMs = total / history.count;
+    return stats;
+}
+
+std::vector<GpuProfiler::Stats> GpuProfiler::getAllStats() const
+{
+    std::vector<Stats> allStats;
+    for (uint32_t scope = 0; scope < m_vecScopes.size(); ++scope)
+        allStats.push_back(getStats(scope));
+    return allStats;
+}
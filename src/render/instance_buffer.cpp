@@ -0,0 +1,108 @@
+#include "render/instance_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void InstanceBuffer::init(vk::Buffer buffer, void* pMapped, uint32_t capacity, uint32_t frameCount, vk::DeviceSize alignment)
+{
+    if (!pMapped) throw std::runtime_error("instance buffer memory is not host visible!");
+
+    alignment = alignment > 0 ? alignment : 1;
+    m_Buffer = buffer;
+    m_pMapped = static_cast<uint8_t*>(pMapped);
+    m_FrameSize = (capacity * sizeof(InstanceData) + alignment - 1) / alignment * alignment;
+    m_Capacity = capacity;
+    m_vecDirty.assign(frameCount, DirtyRange{});
+    clear();
+}
+
+InstanceBuffer::Handle InstanceBuffer::add(const glm::mat4& model)
+{
+    if (m_vecInstances.size() >= m_Capacity) throw std::runtime_error("instance buffer is full!");
+
+    Handle handle;
+    if (!m_vecFreeHandles.empty()) {
+        handle = m_vecFreeHandles.back();
+        m_vecFreeHandles.pop_back();
+    } else {
+        handle = static_cast<Handle>(m_vecSlotOfHandle.size());
+        m_vecSlotOfHandle.push_back(0);
+    }
+
+    uint32_t slot = static_cast<uint32_t>(m_vecInstances.size());
+    m_vecInstances.emplace_back();
+    m_vecHandleOfSlot.push_back(handle);
+    m_vecSlotOfHandle[handle] = slot;
+    store(slot, model);
+    return handle;
+}
+
+void InstanceBuffer::remove(Handle handle)
+{
+    uint32_t slot = slotOf(handle);
+    uint32_t last = static_cast<uint32_t>(m_vecInstances.size() - 1);
+    if (slot != last) {
+        m_vecInstances[slot] = m_vecInstances[last];
+        m_vecHandleOfSlot[slot] = m_vecHandleOfSlot[last];
+        m_vecSlotOfHandle[m_vecHandleOfSlot[slot]] = slot;
+        markDirty(slot);
+    }
+    m_vecInstances.pop_back();
+    m_vecHandleOfSlot.pop_back();
+    m_vecSlotOfHandle[handle] = INVALID_SLOT;
+    m_vecFreeHandles.push_back(handle);
+}
+
+void InstanceBuffer::update(Handle handle, const glm::mat4& model)
+{
+    store(slotOf(handle), model);
+}
+
+void InstanceBuffer::clear()
+{
+    m_vecInstances.clear();
+    m_vecSlotOfHandle.clear();
+    m_vecHandleOfSlot.clear();
+    m_vecFreeHandles.clear();
+    std::fill(m_vecDirty.begin(), m_vecDirty.end(), DirtyRange{});
+}
+
+uint32_t InstanceBuffer::slotOf(Handle handle) const
+{
+    if (handle >= m_vecSlotOfHandle.size() || m_vecSlotOfHandle[handle] == INVALID_SLOT)
+        throw std::runtime_error("invalid instance handle!");
+    return m_vecSlotOfHandle[handle];
+}
+
+uint32_t InstanceBuffer::beginFrame(uint32_t frame)
+{
+    frame %= static_cast<uint32_t>(m_vecDirty.size());
+    vk::DeviceSize frameBase = m_FrameSize * frame;
+
+    DirtyRange& dirty = m_vecDirty[frame];
+    uint32_t end = std::min(dirty.end, getCount());
+    if (dirty.begin < end)
+        memcpy(m_pMapped + frameBase + dirty.begin * sizeof(InstanceData), m_vecInstances.data() + dirty.begin,
+            (end - dirty.begin) * sizeof(InstanceData));
+    dirty = DirtyRange{};
+
+    return static_cast<uint32_t>(frameBase);
+}
+
+void InstanceBuffer::markDirty(uint32_t slot)
+{
+    for (DirtyRange& dirty : m_vecDirty) {
+        dirty.begin = std::min(dirty.begin, slot);
+        dirty.end = std::max(dirty.end, slot + 1);
+    }
+}
+
+void InstanceBuffer::store(uint32_t slot, const glm::mat4& model)
+{
+    // glm is column major, row r of the matrix is element r of every column
+    InstanceData& instance = m_vecInstances[slot];
+    for (int row = 0; row < 3; ++row)
+        instance.rows[row] = glm::vec4(model[0][row], model[1][row], model[2][row], model[3][row]);
+    markDirty(slot);
+}
@@ -0,0 +1,246 @@
+#include "render/job_system.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    // tryPop rounds a worker makes before it goes to sleep, jobs often come in bursts
+    constexpr uint32_t IDLE_SPIN_COUNT = 64;
+
+    thread_local const JobSystem* t_pOwner = nullptr;
+    thread_local uint32_t t_WorkerIndex = 0;
+}
+
+std::atomic<JobSystem*> JobSystem::s_pActive{ nullptr };
+
+void JobSystem::Counter::fail(std::exception_ptr exception)
+{
+    std::lock_guard<std::mutex> lock(m_ExceptionMutex);
+    if (!m_Exception) m_Exception = exception;
+    m_Failed.store(true, std::memory_order_release);
+}
+
+JobSystem::TaskGraph::TaskId JobSystem::TaskGraph::add(Job job)
+{
+    m_vecTasks.emplace_back();
+    m_vecTasks.back().job = std::move(job);
+    return static_cast<TaskId>(m_vecTasks.size() - 1);
+}
+
+void JobSystem::TaskGraph::addDependency(TaskId before, TaskId after)
+{
+    if (before >= after || after >= m_vecTasks.size())
+        throw std::runtime_error("task dependency must point to a later task!");
+    m_vecTasks[before].vecSuccessors.push_back(after);
+    ++m_vecTasks[after].dependencyCount;
+}
+
+void JobSystem::init(uint32_t workerCount)
+{
+    if (!m_vecWorkers.empty()) throw std::runtime_error("job system is already running!");
+
+    m_Stopping = false;
+    m_vecWorkers.resize(workerCount + 1);
+    for (auto& pWorker : m_vecWorkers) pWorker = std::make_unique<Worker>();
+    // every deque has to exist before a worker starts stealing
+    for (uint32_t i = 1; i < m_vecWorkers.size(); ++i)
+        m_vecWorkers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+
+    JobSystem* pExpected = nullptr;
+    s_pActive.compare_exchange_strong(pExpected, this, std::memory_order_acq_rel);
+}
+
+void JobSystem::shutdown()
+{
+    if (m_vecWorkers.empty()) return;
+
+    JobSystem* pExpected = this;
+    s_pActive.compare_exchange_strong(pExpected, nullptr, std::memory_order_acq_rel);
+
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_Stopping = true;
+    }
+    m_SleepCondition.notify_all();
+    for (auto& pWorker : m_vecWorkers)
+        if (pWorker->thread.joinable()) pWorker->thread.join();
+    m_vecWorkers.clear();
+}
+
+void JobSystem::run(Job job, Counter& counter)
+{
+    counter.m_Pending.fetch_add(1, std::memory_order_relaxed);
+    push(Entry{ std::move(job), &counter });
+}
+
+void JobSystem::run(TaskGraph& graph, Counter& counter)
+{
+    size_t taskCount = graph.m_vecTasks.size();
+    graph.m_pRemaining.reset(new std::atomic<uint32_t>[taskCount]);
+    for (size_t i = 0; i < taskCount; ++i)
+        graph.m_pRemaining[i].store(graph.m_vecTasks[i].dependencyCount, std::memory_order_relaxed);
+
+    // the counter covers every task up front, successors are pushed by their last dependency
+    counter.m_Pending.fetch_add(static_cast<uint32_t>(taskCount), std::memory_order_relaxed);
+    for (size_t i = 0; i < taskCount; ++i)
+        if (graph.m_vecTasks[i].dependencyCount == 0)
+            scheduleTask(graph, static_cast<TaskGraph::TaskId>(i), counter);
+}
+
+void JobSystem::wait(Counter& counter)
+{
+    uint32_t workerIndex = currentWorkerIndex();
+    Entry entry;
+    while (!counter.isDone()) {
+        if (tryPop(workerIndex, entry)) {
+            execute(entry);
+            entry = Entry{};
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    if (counter.m_Failed.load(std::memory_order_acquire)) {
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(counter.m_ExceptionMutex);
+            std::swap(exception, counter.m_Exception);
+            counter.m_Failed.store(false, std::memory_order_relaxed);
+        }
+        std::rethrow_exception(exception);
+    }
+}
+
+void JobSystem::parallelFor(size_t count, uint32_t batchCount, const std::function<void(size_t)>& func)
+{
+    uint32_t batches = static_cast<uint32_t>(std::min<size_t>(batchCount, count));
+    if (batches <= 1 || m_vecWorkers.size() <= 1) {
+        for (size_t i = 0; i < count; ++i) func(i);
+        return;
+    }
+
+    std::atomic<size_t> next{ 0 };
+    Counter counter;
+    auto batch = [&]() {
+        for (size_t i = next++; i < count; i = next++) func(i);
+    };
+    for (uint32_t i = 1; i < batches; ++i) run(batch, counter);
+
+    // the other batches still reference this frame, wait for them before rethrowing
+    try {
+        batch();
+    } catch (...) {
+        counter.fail(std::current_exception());
+    }
+    wait(counter);
+}
+
+void JobSystem::push(Entry entry)
+{
+    if (m_vecWorkers.empty()) {
+        execute(entry);
+        return;
+    }
+
+    Worker& worker = *m_vecWorkers[currentWorkerIndex()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.entries.push_back(std::move(entry));
+    }
+
+    // a sleeper counts itself before checking the queue, so one of the two sides sees the other
+    m_QueuedCount.fetch_add(1);
+    if (m_SleepingCount.load() > 0) {
+        { std::lock_guard<std::mutex> lock(m_SleepMutex); }
+        m_SleepCondition.notify_one();
+    }
+}
+
+bool JobSystem::tryPop(uint32_t workerIndex, Entry& entry)
+{
+    if (m_QueuedCount.load(std::memory_order_relaxed) == 0) return false;
+
+    // newest own job first while it is still in cache, the oldest of anyone else
+    Worker& own = *m_vecWorkers[workerIndex];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.entries.empty()) {
+            entry = std::move(own.entries.back());
+            own.entries.pop_back();
+            m_QueuedCount.fetch_sub(1);
+            return true;
+        }
+    }
+
+    uint32_t workerCount = static_cast<uint32_t>(m_vecWorkers.size());
+    for (uint32_t offset = 1; offset < workerCount; ++offset) {
+        Worker& victim = *m_vecWorkers[(workerIndex + offset) % workerCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.entries.empty()) {
+            entry = std::move(victim.entries.front());
+            victim.entries.pop_front();
+            m_QueuedCount.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Entry& entry)
+{
+    try {
+        entry.job();
+    } catch (...) {
+        entry.pCounter->fail(std::current_exception());
+    }
+    // the waiter may release the counter right after this
+    entry.pCounter->m_Pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::scheduleTask(TaskGraph& graph, TaskGraph::TaskId id, Counter& counter)
+{
+    push(Entry{ [this, &graph, id, &counter]() {
+        TaskGraph::Task& task = graph.m_vecTasks[id];
+        try {
+            if (!counter.m_Failed.load(std::memory_order_acquire)) task.job();
+        } catch (...) {
+            counter.fail(std::current_exception());
+        }
+        for (TaskGraph::TaskId successor : task.vecSuccessors)
+            if (graph.m_pRemaining[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                scheduleTask(graph, successor, counter);
+    }, &counter });
+}
+
+void JobSystem::workerLoop(uint32_t workerIndex)
+{
+    t_pOwner = this;
+    t_WorkerIndex = workerIndex;
+
+    Entry entry;
+    uint32_t idleSpins = 0;
+    for (;;) {
+        if (tryPop(workerIndex, entry)) {
+            execute(entry);
+            entry = Entry{};
+            idleSpins = 0;
+            continue;
+        }
+        if (++idleSpins < IDLE_SPIN_COUNT) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_SleepMutex);
+        m_SleepingCount.fetch_add(1);
+        m_SleepCondition.wait(lock, [&]() { return m_Stopping || m_QueuedCount.load() > 0; });
+        m_SleepingCount.fetch_sub(1);
+        if (m_Stopping) return;
+        idleSpins = 0;
+    }
+}
+
+uint32_t JobSystem::currentWorkerIndex() const
+{
+    return t_pOwner == this ? t_WorkerIndex : 0;
+}
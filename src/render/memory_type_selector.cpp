@@ -0,0 +1,75 @@
+#include "render/memory_type_selector.h"
+
+#include <stdexcept>
+
+void MemoryTypeSelector::init(vk::PhysicalDevice physicalDevice)
+{
+    m_MemoryProperties = physicalDevice.getMemoryProperties();
+}
+
+std::optional<uint32_t> MemoryTypeSelector::find(uint32_t typeFilter, vk::MemoryPropertyFlags required, MemoryUsage usage) const
+{
+    std::optional<uint32_t> best;
+    int bestScore = 0;
+
+    for (uint32_t i = 0; i < m_MemoryProperties.memoryTypeCount; ++i) {
+        if (!(typeFilter & (1u << i))) continue;
+        if ((m_MemoryProperties.memoryTypes[i].propertyFlags & required) != required) continue;
+
+        // ties keep the lower index, the spec orders types by performance
+        int typeScore = score(i, usage);
+        if (!best || typeScore > bestScore) {
+            best = i;
+            bestScore = typeScore;
+        }
+    }
+
+    return best;
+}
+
+uint32_t MemoryTypeSelector::select(uint32_t typeFilter, vk::MemoryPropertyFlags required, MemoryUsage usage) const
+{
+    auto memoryType = find(typeFilter, required, usage);
+    if (!memoryType) throw std::runtime_error("failed to find suitable memory type!");
+    return *memoryType;
+}
+
+int MemoryTypeSelector::score(uint32_t memoryTypeIndex, MemoryUsage usage) const
+{
+    vk::MemoryPropertyFlags flags = m_MemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    bool deviceLocal = static_cast<bool>(flags & vk::MemoryPropertyFlagBits::eDeviceLocal);
+    bool hostVisible = static_cast<bool>(flags & vk::MemoryPropertyFlagBits::eHostVisible);
+    bool hostCoherent = static_cast<bool>(flags & vk::MemoryPropertyFlagBits::eHostCoherent);
+    bool hostCached = static_cast<bool>(flags & vk::MemoryPropertyFlagBits::eHostCached);
+    bool lazilyAllocated = static_cast<bool>(flags & vk::MemoryPropertyFlagBits::eLazilyAllocated);
+
+    int typeScore = 0;
+    switch (usage) {
+    case MemoryUsage::eGpuOnly:
+        if (deviceLocal) typeScore += 100;
+        if (hostVisible) typeScore -= 50;   // often the small BAR window
+        if (lazilyAllocated) typeScore -= 200;
+        break;
+    case MemoryUsage::eTransient:
+        if (deviceLocal) typeScore += 100;
+        if (lazilyAllocated) typeScore += 50;
+        if (hostVisible) typeScore -= 50;
+        break;
+    case MemoryUsage::eUpload:
+        if (hostCoherent) typeScore += 20;
+        if (deviceLocal) typeScore -= 30;   // leave BAR space for dynamic data
+        if (hostCached) typeScore -= 10;    // write-combined is better for streaming writes
+        break;
+    case MemoryUsage::eDynamic:
+        if (deviceLocal && hostVisible) typeScore += 100;
+        if (hostCoherent) typeScore += 20;
+        if (hostCached) typeScore -= 10;
+        break;
+    case MemoryUsage::eReadback:
+        if (hostCached) typeScore += 100;
+        if (hostCoherent) typeScore += 20;
+        if (deviceLocal) typeScore -= 10;
+        break;
+    }
+    return typeScore;
+}
@@ -0,0 +1,174 @@
+#include "render/mesh_cache.h"
+#include "render/source_key.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+    constexpr uint32_t MESH_CACHE_MAGIC = 0x4D4B564C; // "LVKM"
+    constexpr uint64_t BLOB_ALIGNMENT = 16;
+    constexpr uint32_t MAX_SUBMESHES = 1 << 20;
+    constexpr uint32_t MAX_LODS = 32;
+
+    struct MeshCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        SourceKey source;
+        uint32_t vertexStride;
+        uint32_t indexSize;
+        uint32_t attributeCount;
+        uint32_t subMeshCount;
+        uint32_t lodCount;
+        uint32_t reserved;
+        uint64_t vertexCount;
+        uint64_t indexCount;
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        MeshBounds bounds;
+        MeshDequantize dequantize;
+        MeshBuildSettings settings;
+    };
+
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+    }
+}
+
+bool MeshCache::load(const std::string& cachePath, const std::string& sourcePath, const MeshLayout& layout,
+    const MeshBuildSettings& settings)
+{
+    close();
+
+    if (!m_File.open(cachePath)) return false;
+
+    const uint8_t* pData = m_File.getData();
+    size_t fileSize = m_File.getSize();
+    if (fileSize < sizeof(MeshCacheHeader)) {
+        close();
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, pData, sizeof(header));
+
+    bool valid = header.magic == MESH_CACHE_MAGIC &&
+        header.version == VERSION &&
+        header.vertexStride == layout.vertexStride &&
+        memcmp(&header.settings, &settings, sizeof(settings)) == 0 &&
+        (header.indexSize == 2 || header.indexSize == 4) &&
+        header.attributeCount == layout.attributes.size() &&
+        header.subMeshCount <= MAX_SUBMESHES &&
+        header.lodCount <= MAX_LODS;
+
+    uint64_t attributesEnd = sizeof(MeshCacheHeader) + uint64_t(header.attributeCount) * sizeof(MeshVertexAttribute);
+    uint64_t subMeshesEnd = attributesEnd + uint64_t(header.subMeshCount) * sizeof(SubMesh);
+    uint64_t lodsEnd = subMeshesEnd + uint64_t(header.lodCount) * sizeof(MeshLod);
+    valid = valid && lodsEnd <= fileSize &&
+        memcmp(pData + sizeof(MeshCacheHeader), layout.attributes.data(),
+            layout.attributes.size() * sizeof(MeshVertexAttribute)) == 0;
+
+    // counts come from disk, keep the products from wrapping
+    uint64_t maxCount = std::numeric_limits<uint64_t>::max() / std::max<uint64_t>(16, std::max(header.vertexStride, header.indexSize));
+    valid = valid && header.vertexCount < maxCount && header.indexCount < maxCount &&
+        header.vertexOffset >= lodsEnd &&
+        header.vertexOffset + header.vertexCount * header.vertexStride <= fileSize &&
+        header.indexOffset >= header.vertexOffset + header.vertexCount * header.vertexStride &&
+        header.indexOffset + header.indexCount * header.indexSize <= fileSize;
+
+    if (valid) {
+        m_View.subMeshes.resize(header.subMeshCount);
+        memcpy(m_View.subMeshes.data(), pData + attributesEnd, header.subMeshCount * sizeof(SubMesh));
+        for (const SubMesh& subMesh : m_View.subMeshes)
+            valid = valid && subMesh.firstIndex <= header.indexCount &&
+                subMesh.indexCount <= header.indexCount - subMesh.firstIndex;
+
+        m_View.lods.resize(header.lodCount);
+        memcpy(m_View.lods.data(), pData + subMeshesEnd, header.lodCount * sizeof(MeshLod));
+        for (const MeshLod& lod : m_View.lods)
+            valid = valid && lod.firstSubMesh <= header.subMeshCount &&
+                lod.subMeshCount <= header.subMeshCount - lod.firstSubMesh;
+    }
+
+    valid = valid && SourceKey::matches(header.source, sourcePath);
+
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    m_View.pVertices = pData + header.vertexOffset;
+    m_View.vertexCount = header.vertexCount;
+    m_View.pIndices = pData + header.indexOffset;
+    m_View.indexCount = header.indexCount;
+    m_View.indexSize = header.indexSize;
+    m_View.bounds = header.bounds;
+    m_View.dequantize = header.dequantize;
+    return true;
+}
+
+void MeshCache::close()
+{
+    m_File.close();
+    m_View = MeshView{};
+}
+
+bool MeshCache::store(const std::string& cachePath, const std::string& sourcePath,
+    const MeshLayout& layout, const MeshBuildSettings& settings, const MeshView& mesh)
+{
+    MeshCacheHeader header{};
+    if (!SourceKey::compute(sourcePath, header.source)) return false;
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = VERSION;
+    header.vertexStride = layout.vertexStride;
+    header.indexSize = mesh.indexSize;
+    header.attributeCount = static_cast<uint32_t>(layout.attributes.size());
+    header.subMeshCount = static_cast<uint32_t>(mesh.subMeshes.size());
+    header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+    header.vertexCount = mesh.vertexCount;
+    header.indexCount = mesh.indexCount;
+
+    uint64_t attributesSize = layout.attributes.size() * sizeof(MeshVertexAttribute);
+    uint64_t subMeshesSize = mesh.subMeshes.size() * sizeof(SubMesh);
+    uint64_t lodsSize = mesh.lods.size() * sizeof(MeshLod);
+    uint64_t tablesEnd = sizeof(MeshCacheHeader) + attributesSize + subMeshesSize + lodsSize;
+    uint64_t vertexSize = mesh.vertexCount * layout.vertexStride;
+    header.vertexOffset = alignOffset(tablesEnd);
+    header.indexOffset = alignOffset(header.vertexOffset + vertexSize);
+    header.bounds = mesh.bounds;
+    header.dequantize = mesh.dequantize;
+    header.settings = settings;
+
+    const char padding[BLOB_ALIGNMENT] = {};
+    return writeFileAtomic(cachePath, {
+        { &header, sizeof(header) },
+        { layout.attributes.data(), attributesSize },
+        { mesh.subMeshes.data(), subMeshesSize },
+        { mesh.lods.data(), lodsSize },
+        { padding, header.vertexOffset - tablesEnd },
+        { mesh.pVertices, vertexSize },
+        { padding, header.indexOffset - header.vertexOffset - vertexSize },
+        { mesh.pIndices, mesh.indexCount * mesh.indexSize },
+    });
+}
+
+MeshBounds MeshCache::computeBounds(const void* vertices, uint64_t vertexCount, uint32_t stride, uint32_t positionOffset)
+{
+    MeshBounds bounds;
+    if (vertexCount == 0) return bounds;
+
+    const uint8_t* pVertex = static_cast<const uint8_t*>(vertices) + positionOffset;
+    memcpy(bounds.min, pVertex, sizeof(bounds.min));
+    memcpy(bounds.max, pVertex, sizeof(bounds.max));
+    for (uint64_t i = 1; i < vertexCount; ++i) {
+        pVertex += stride;
+        float position[3];
+        memcpy(position, pVertex, sizeof(position));
+        for (int axis = 0; axis < 3; ++axis) {
+            bounds.min[axis] = std::min(bounds.min[axis], position[axis]);
+            bounds.max[axis] = std::max(bounds.max[axis], position[axis]);
+        }
+    }
+    return bounds;
+}
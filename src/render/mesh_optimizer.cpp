@@ -0,0 +1,248 @@
+#include "render/mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace {
+    // ACMR a cluster must get back to before it can end, relative to the whole mesh
+    constexpr float OVERDRAW_CLUSTER_THRESHOLD = 1.05f;
+
+    // FIFO cache in O(1) per lookup: a vertex is resident while fewer than
+    // cacheSize misses happened since it was inserted.
+    class FifoCache {
+    public:
+        FifoCache(size_t vertexCount, uint32_t cacheSize) : m_vecInserted(vertexCount, 0), m_CacheSize(cacheSize) {}
+
+        // Returns true on a miss.
+        bool access(uint32_t vertex)
+        {
+            uint64_t inserted = m_vecInserted[vertex];
+            if (inserted != 0 && m_Misses - inserted < m_CacheSize) return false;
+            m_vecInserted[vertex] = ++m_Misses;
+            return true;
+        }
+
+        // Empties the cache without touching every vertex.
+        void flush() { m_Misses += m_CacheSize; }
+
+    private:
+        std::vector<uint64_t> m_vecInserted;
+        uint64_t m_Misses = 0;
+        uint32_t m_CacheSize;
+    };
+
+    struct Vec3 {
+        double x, y, z;
+    };
+
+    Vec3 loadPosition(const float* positions, uint32_t positionStride, uint32_t vertex)
+    {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + size_t(vertex) * positionStride);
+        return { p[0], p[1], p[2] };
+    }
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& vecIndices, size_t vertexCount, uint32_t cacheSize)
+{
+    size_t triangleCount = vecIndices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // triangles around every vertex, CSR layout
+    std::vector<uint32_t> vecLive(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i) ++vecLive[vecIndices[i]];
+    std::vector<uint32_t> vecAdjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) vecAdjacencyOffsets[v + 1] = vecAdjacencyOffsets[v] + vecLive[v];
+    std::vector<uint32_t> vecAdjacency(vecAdjacencyOffsets[vertexCount]);
+    std::vector<uint32_t> vecFill(vecAdjacencyOffsets.begin(), vecAdjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+        for (size_t corner = 0; corner < 3; ++corner)
+            vecAdjacency[vecFill[vecIndices[t * 3 + corner]]++] = static_cast<uint32_t>(t);
+
+    std::vector<uint64_t> vecCacheTime(vertexCount, 0);
+    std::vector<uint8_t> vecEmitted(triangleCount, 0);
+    std::vector<uint32_t> vecDeadEnds;
+    std::vector<uint32_t> vecCandidates;
+    std::vector<uint32_t> vecOutput;
+    vecOutput.reserve(triangleCount * 3);
+    uint64_t time = cacheSize + 1;
+    size_t cursor = 0;
+
+    auto skipDeadEnd = [&]() -> int64_t {
+        while (!vecDeadEnds.empty()) {
+            uint32_t vertex = vecDeadEnds.back();
+            vecDeadEnds.pop_back();
+            if (vecLive[vertex] > 0) return vertex;
+        }
+        for (; cursor < vertexCount; ++cursor)
+            if (vecLive[cursor] > 0) return static_cast<int64_t>(cursor);
+        return -1;
+    };
+
+    int64_t fan = skipDeadEnd();
+    while (fan >= 0) {
+        vecCandidates.clear();
+        for (uint32_t a = vecAdjacencyOffsets[fan]; a < vecAdjacencyOffsets[fan + 1]; ++a) {
+            uint32_t t = vecAdjacency[a];
+            if (vecEmitted[t]) continue;
+            vecEmitted[t] = 1;
+            for (size_t corner = 0; corner < 3; ++corner) {
+                uint32_t vertex = vecIndices[t * 3 + corner];
+                vecOutput.push_back(vertex);
+                vecDeadEnds.push_back(vertex);
+                vecCandidates.push_back(vertex);
+                --vecLive[vertex];
+                if (time - vecCacheTime[vertex] > cacheSize) vecCacheTime[vertex] = time++;
+            }
+        }
+
+        // prefer the neighbour that stays in cache while its fan is emitted,
+        // and among those the one that entered the cache first
+        int64_t next = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : vecCandidates) {
+            if (vecLive[vertex] == 0) continue;
+            int64_t priority = 0;
+            if (time - vecCacheTime[vertex] + 2 * vecLive[vertex] <= cacheSize) priority = static_cast<int64_t>(time - vecCacheTime[vertex]);
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        fan = next >= 0 ? next : skipDeadEnd();
+    }
+
+    // a trailing partial triangle is kept as it was
+    vecOutput.insert(vecOutput.end(), vecIndices.begin() + triangleCount * 3, vecIndices.end());
+    vecIndices.swap(vecOutput);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& vecIndices, const float* positions, uint32_t positionStride,
+    size_t vertexCount, uint32_t cacheSize)
+{
+    size_t triangleCount = vecIndices.size() / 3;
+    if (triangleCount == 0) return;
+
+    float meshAcmr = analyzeVertexCache(vecIndices, vertexCount, cacheSize).acmr;
+
+    // A cluster ends once its own ACMR, starting from a cold cache, is back
+    // near the mesh's; reordering clusters then costs little cache efficiency.
+    std::vector<size_t> vecClusterStarts;
+    FifoCache cache(vertexCount, cacheSize);
+    size_t clusterMisses = 0;
+    size_t clusterTriangles = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (clusterTriangles == 0) {
+            vecClusterStarts.push_back(t);
+            cache.flush();
+        }
+        for (size_t corner = 0; corner < 3; ++corner)
+            clusterMisses += cache.access(vecIndices[t * 3 + corner]);
+        ++clusterTriangles;
+        if (clusterMisses <= OVERDRAW_CLUSTER_THRESHOLD * meshAcmr * clusterTriangles) {
+            clusterMisses = 0;
+            clusterTriangles = 0;
+        }
+    }
+    vecClusterStarts.push_back(triangleCount);
+    size_t clusterCount = vecClusterStarts.size() - 1;
+
+    // area-weighted centroid and normal of every cluster and of the mesh
+    std::vector<Vec3> vecCentroids(clusterCount, Vec3{ 0.0, 0.0, 0.0 });
+    std::vector<Vec3> vecNormals(clusterCount, Vec3{ 0.0, 0.0, 0.0 });
+    Vec3 meshCentroid{ 0.0, 0.0, 0.0 };
+    double meshArea = 0.0;
+    for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+        double clusterArea = 0.0;
+        for (size_t t = vecClusterStarts[cluster]; t < vecClusterStarts[cluster + 1]; ++t) {
+            Vec3 a = loadPosition(positions, positionStride, vecIndices[t * 3 + 0]);
+            Vec3 b = loadPosition(positions, positionStride, vecIndices[t * 3 + 1]);
+            Vec3 c = loadPosition(positions, positionStride, vecIndices[t * 3 + 2]);
+            Vec3 ab{ b.x - a.x, b.y - a.y, b.z - a.z };
+            Vec3 ac{ c.x - a.x, c.y - a.y, c.z - a.z };
+            Vec3 normal{ ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x };
+            double area = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+
+            vecNormals[cluster].x += normal.x;
+            vecNormals[cluster].y += normal.y;
+            vecNormals[cluster].z += normal.z;
+            vecCentroids[cluster].x += (a.x + b.x + c.x) / 3.0 * area;
+            vecCentroids[cluster].y += (a.y + b.y + c.y) / 3.0 * area;
+            vecCentroids[cluster].z += (a.z + b.z + c.z) / 3.0 * area;
+            clusterArea += area;
+        }
+
+        meshCentroid.x += vecCentroids[cluster].x;
+        meshCentroid.y += vecCentroids[cluster].y;
+        meshCentroid.z += vecCentroids[cluster].z;
+        meshArea += clusterArea;
+        if (clusterArea > 0.0) {
+            vecCentroids[cluster].x /= clusterArea;
+            vecCentroids[cluster].y /= clusterArea;
+            vecCentroids[cluster].z /= clusterArea;
+        }
+    }
+    if (meshArea > 0.0) {
+        meshCentroid.x /= meshArea;
+        meshCentroid.y /= meshArea;
+        meshCentroid.z /= meshArea;
+    }
+
+    // how far a cluster sits out along its own facing direction
+    std::vector<double> vecSortKeys(clusterCount);
+    for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+        const Vec3& n = vecNormals[cluster];
+        double length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        Vec3 offset{ vecCentroids[cluster].x - meshCentroid.x, vecCentroids[cluster].y - meshCentroid.y,
+            vecCentroids[cluster].z - meshCentroid.z };
+        vecSortKeys[cluster] = length > 0.0 ? (offset.x * n.x + offset.y * n.y + offset.z * n.z) / length : 0.0;
+    }
+
+    std::vector<size_t> vecOrder(clusterCount);
+    std::iota(vecOrder.begin(), vecOrder.end(), 0);
+    std::stable_sort(vecOrder.begin(), vecOrder.end(), [&](size_t a, size_t b) { return vecSortKeys[a] > vecSortKeys[b]; });
+
+    std::vector<uint32_t> vecOutput;
+    vecOutput.reserve(vecIndices.size());
+    for (size_t cluster : vecOrder)
+        vecOutput.insert(vecOutput.end(), vecIndices.begin() + vecClusterStarts[cluster] * 3,
+            vecIndices.begin() + vecClusterStarts[cluster + 1] * 3);
+    vecOutput.insert(vecOutput.end(), vecIndices.begin() + triangleCount * 3, vecIndices.end());
+    vecIndices.swap(vecOutput);
+}
+
+size_t MeshOptimizer::optimizeVertexFetch(std::vector<uint32_t>& vecIndices, void* vertices, uint32_t stride, size_t vertexCount)
+{
+    std::vector<uint32_t> vecRemap(vertexCount, UINT32_MAX);
+    std::vector<uint8_t> vecVertices;
+    vecVertices.reserve(vertexCount * stride);
+    uint8_t* pVertices = static_cast<uint8_t*>(vertices);
+
+    uint32_t next = 0;
+    for (uint32_t& index : vecIndices) {
+        if (vecRemap[index] == UINT32_MAX) {
+            vecRemap[index] = next++;
+            vecVertices.insert(vecVertices.end(), pVertices + size_t(index) * stride, pVertices + size_t(index + 1) * stride);
+        }
+        index = vecRemap[index];
+    }
+
+    memcpy(pVertices, vecVertices.data(), vecVertices.size());
+    return next;
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t>& vecIndices, size_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    size_t triangleCount = vecIndices.size() / 3;
+    if (triangleCount == 0 || vertexCount == 0) return stats;
+
+    FifoCache cache(vertexCount, cacheSize);
+    size_t misses = 0;
+    for (size_t i = 0; i < triangleCount * 3; ++i) misses += cache.access(vecIndices[i]);
+
+    stats.acmr = static_cast<float>(misses) / triangleCount;
+    stats.atvr = static_cast<float>(misses) / vertexCount;
+    return stats;
+}
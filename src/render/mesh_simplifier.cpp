@@ -0,0 +1,270 @@
+#include "render/mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <tuple>
+
+namespace {
+    // keeps open borders in place relative to the surface planes
+    constexpr double BORDER_WEIGHT = 10.0;
+
+    struct Vec3 {
+        double x, y, z;
+    };
+
+    Vec3 operator-(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    double dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Vec3 cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+    // Sum of squared distances to a set of planes: p.A.p + 2 b.p + c.
+    struct Quadric {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+        double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+        double c = 0.0;
+        double weight = 0.0;
+
+        void addPlane(const Vec3& n, double d, double planeWeight)
+        {
+            a00 += planeWeight * n.x * n.x; a01 += planeWeight * n.x * n.y; a02 += planeWeight * n.x * n.z;
+            a11 += planeWeight * n.y * n.y; a12 += planeWeight * n.y * n.z; a22 += planeWeight * n.z * n.z;
+            b0 += planeWeight * d * n.x; b1 += planeWeight * d * n.y; b2 += planeWeight * d * n.z;
+            c += planeWeight * d * d;
+            weight += planeWeight;
+        }
+
+        void add(const Quadric& other)
+        {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02;
+            a11 += other.a11; a12 += other.a12; a22 += other.a22;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2;
+            c += other.c;
+            weight += other.weight;
+        }
+
+        double evaluate(const Vec3& p) const
+        {
+            double value = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+                2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+            return std::max(value, 0.0);
+        }
+    };
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    }
+
+    uint32_t positionBits(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits == 0x80000000u ? 0 : bits;
+    }
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(const std::vector<uint32_t>& vecIndices, const float* positions,
+    uint32_t positionStride, size_t vertexCount, size_t targetIndexCount, float& error)
+{
+    error = 0.0f;
+    std::vector<uint32_t> vecResult(vecIndices.begin(), vecIndices.begin() + vecIndices.size() / 3 * 3);
+    if (vecResult.empty() || vertexCount == 0) return vecResult;
+
+    // vertices that share a position act as one; vecCanonical names the group
+    std::vector<Vec3> vecPositions(vertexCount);
+    std::vector<uint32_t> vecOrder(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + v * positionStride);
+        vecPositions[v] = { p[0], p[1], p[2] };
+    }
+    auto bitsOf = [&](uint32_t v) {
+        const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + size_t(v) * positionStride);
+        return std::make_tuple(positionBits(p[0]), positionBits(p[1]), positionBits(p[2]));
+    };
+    std::iota(vecOrder.begin(), vecOrder.end(), 0);
+    std::sort(vecOrder.begin(), vecOrder.end(), [&](uint32_t a, uint32_t b) { return bitsOf(a) < bitsOf(b); });
+    std::vector<uint32_t> vecCanonical(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+        vecCanonical[vecOrder[i]] = (i > 0 && bitsOf(vecOrder[i]) == bitsOf(vecOrder[i - 1])) ? vecCanonical[vecOrder[i - 1]] : vecOrder[i];
+
+    std::vector<Quadric> vecQuadrics(vertexCount);
+    for (size_t t = 0; t < vecResult.size(); t += 3) {
+        const Vec3& a = vecPositions[vecResult[t]];
+        Vec3 normal = cross(vecPositions[vecResult[t + 1]] - a, vecPositions[vecResult[t + 2]] - a);
+        double length = std::sqrt(dot(normal, normal));
+        if (length == 0.0) continue;
+        normal = { normal.x / length, normal.y / length, normal.z / length };
+        for (size_t corner = 0; corner < 3; ++corner)
+            vecQuadrics[vecCanonical[vecResult[t + corner]]].addPlane(normal, -dot(normal, a), 1.0);
+    }
+
+    std::vector<uint32_t> vecRemap(vertexCount);
+    std::iota(vecRemap.begin(), vecRemap.end(), 0);
+    std::vector<uint8_t> vecTouched(vertexCount);
+    std::vector<uint8_t> vecBorder(vertexCount);
+    std::vector<uint8_t> vecLocked(vertexCount);
+    std::vector<uint32_t> vecAdjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> vecAdjacency;
+    std::vector<std::pair<uint64_t, uint32_t>> vecEdges;
+    std::vector<Collapse> vecCollapses;
+    std::vector<std::pair<uint32_t, uint32_t>> vecPartners;
+    double maxError = 0.0;
+    bool firstPass = true;
+
+    while (vecResult.size() > targetIndexCount) {
+        size_t triangleCount = vecResult.size() / 3;
+
+        // undirected edges between position groups, tagged with one triangle using them
+        vecEdges.clear();
+        for (size_t t = 0; t < triangleCount; ++t)
+            for (size_t corner = 0; corner < 3; ++corner)
+                vecEdges.push_back({ edgeKey(vecCanonical[vecResult[t * 3 + corner]], vecCanonical[vecResult[t * 3 + (corner + 1) % 3]]),
+                    static_cast<uint32_t>(t) });
+        std::sort(vecEdges.begin(), vecEdges.end());
+
+        std::fill(vecBorder.begin(), vecBorder.end(), 0);
+        std::fill(vecLocked.begin(), vecLocked.end(), 0);
+        vecCollapses.clear();
+        for (size_t begin = 0, end = 0; begin < vecEdges.size(); begin = end) {
+            while (end < vecEdges.size() && vecEdges[end].first == vecEdges[begin].first) ++end;
+            uint32_t a = static_cast<uint32_t>(vecEdges[begin].first >> 32);
+            uint32_t b = static_cast<uint32_t>(vecEdges[begin].first);
+            size_t count = end - begin;
+            if (count > 2) vecLocked[a] = vecLocked[b] = 1;
+            if (count != 1) continue;
+            vecBorder[a] = vecBorder[b] = 1;
+
+            if (firstPass) {
+                // plane through the border edge, perpendicular to its triangle
+                uint32_t t = vecEdges[begin].second;
+                const Vec3& p0 = vecPositions[vecResult[t * 3]];
+                Vec3 normal = cross(vecPositions[vecResult[t * 3 + 1]] - p0, vecPositions[vecResult[t * 3 + 2]] - p0);
+                Vec3 edge = vecPositions[b] - vecPositions[a];
+                Vec3 side = cross(edge, normal);
+                double length = std::sqrt(dot(side, side));
+                if (length > 0.0) {
+                    side = { side.x / length, side.y / length, side.z / length };
+                    vecQuadrics[a].addPlane(side, -dot(side, vecPositions[a]), BORDER_WEIGHT);
+                    vecQuadrics[b].addPlane(side, -dot(side, vecPositions[a]), BORDER_WEIGHT);
+                }
+            }
+        }
+        firstPass = false;
+
+        for (size_t begin = 0, end = 0; begin < vecEdges.size(); begin = end) {
+            while (end < vecEdges.size() && vecEdges[end].first == vecEdges[begin].first) ++end;
+            uint32_t a = static_cast<uint32_t>(vecEdges[begin].first >> 32);
+            uint32_t b = static_cast<uint32_t>(vecEdges[begin].first);
+            bool borderEdge = end - begin == 1;
+
+            // a border vertex may only slide along the border
+            auto cost = [&](uint32_t from, uint32_t to) {
+                if (vecLocked[from] || (vecBorder[from] && !borderEdge)) return -1.0;
+                return vecQuadrics[from].evaluate(vecPositions[to]) + vecQuadrics[to].evaluate(vecPositions[to]);
+            };
+            double costAB = cost(a, b);
+            double costBA = cost(b, a);
+            if (costAB < 0.0 && costBA < 0.0) continue;
+            if (costBA < 0.0 || (costAB >= 0.0 && costAB <= costBA))
+                vecCollapses.push_back({ a, b, costAB });
+            else
+                vecCollapses.push_back({ b, a, costBA });
+        }
+        std::sort(vecCollapses.begin(), vecCollapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+        // triangles around every position group
+        std::fill(vecAdjacencyOffsets.begin(), vecAdjacencyOffsets.end(), 0);
+        for (uint32_t index : vecResult) ++vecAdjacencyOffsets[vecCanonical[index] + 1];
+        for (size_t v = 0; v < vertexCount; ++v) vecAdjacencyOffsets[v + 1] += vecAdjacencyOffsets[v];
+        vecAdjacency.resize(vecResult.size());
+        std::vector<uint32_t> vecFill(vecAdjacencyOffsets.begin(), vecAdjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < vecResult.size(); ++i)
+            vecAdjacency[vecFill[vecCanonical[vecResult[i]]]++] = static_cast<uint32_t>(i / 3);
+
+        std::fill(vecTouched.begin(), vecTouched.end(), 0);
+        size_t removed = 0;
+        for (const Collapse& collapse : vecCollapses) {
+            if ((triangleCount - removed) * 3 <= targetIndexCount) break;
+            if (vecTouched[collapse.from] || vecTouched[collapse.to]) continue;
+
+            // Every vertex in the moving group needs a partner in the target
+            // group it shares an edge with, so seams close on both sides.
+            // Triangles that keep their area must not flip.
+            vecPartners.clear();
+            size_t collapsing = 0;
+            bool valid = true;
+            for (uint32_t a = vecAdjacencyOffsets[collapse.from]; valid && a < vecAdjacencyOffsets[collapse.from + 1]; ++a) {
+                uint32_t t = vecAdjacency[a];
+                uint32_t corners[3];
+                uint32_t groups[3];
+                for (size_t corner = 0; corner < 3; ++corner) {
+                    corners[corner] = vecRemap[vecResult[t * 3 + corner]];
+                    groups[corner] = vecCanonical[corners[corner]];
+                }
+                if (groups[0] == groups[1] || groups[1] == groups[2] || groups[0] == groups[2]) continue;
+
+                size_t moving = groups[0] == collapse.from ? 0 : groups[1] == collapse.from ? 1 : 2;
+                size_t target = 3;
+                for (size_t corner = 0; corner < 3; ++corner)
+                    if (groups[corner] == collapse.to) target = corner;
+
+                if (target < 3) {
+                    ++collapsing;
+                    for (const auto& partner : vecPartners)
+                        if (partner.first == corners[moving] && partner.second != corners[target]) valid = false;
+                    vecPartners.push_back({ corners[moving], corners[target] });
+                    continue;
+                }
+
+                Vec3 before[3] = { vecPositions[corners[0]], vecPositions[corners[1]], vecPositions[corners[2]] };
+                Vec3 after[3] = { before[0], before[1], before[2] };
+                after[moving] = vecPositions[collapse.to];
+                Vec3 normalBefore = cross(before[1] - before[0], before[2] - before[0]);
+                Vec3 normalAfter = cross(after[1] - after[0], after[2] - after[0]);
+                if (dot(normalBefore, normalAfter) <= 0.0) valid = false;
+            }
+
+            for (uint32_t a = vecAdjacencyOffsets[collapse.from]; valid && a < vecAdjacencyOffsets[collapse.from + 1]; ++a) {
+                uint32_t t = vecAdjacency[a];
+                for (size_t corner = 0; corner < 3; ++corner) {
+                    uint32_t vertex = vecRemap[vecResult[t * 3 + corner]];
+                    if (vecCanonical[vertex] != collapse.from) continue;
+                    bool found = false;
+                    for (const auto& partner : vecPartners) found = found || partner.first == vertex;
+                    valid = valid && found;
+                }
+            }
+            if (!valid || collapsing == 0) continue;
+
+            for (const auto& partner : vecPartners) vecRemap[partner.first] = partner.second;
+            vecQuadrics[collapse.to].add(vecQuadrics[collapse.from]);
+            vecTouched[collapse.from] = vecTouched[collapse.to] = 1;
+            removed += collapsing;
+            const Quadric& merged = vecQuadrics[collapse.to];
+            if (merged.weight > 0.0) maxError = std::max(maxError, merged.evaluate(vecPositions[collapse.to]) / merged.weight);
+        }
+        if (removed == 0) break;
+
+        std::vector<uint32_t> vecNext;
+        vecNext.reserve(vecResult.size() - removed * 3);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            uint32_t corners[3] = { vecRemap[vecResult[t * 3]], vecRemap[vecResult[t * 3 + 1]], vecRemap[vecResult[t * 3 + 2]] };
+            uint32_t g0 = vecCanonical[corners[0]], g1 = vecCanonical[corners[1]], g2 = vecCanonical[corners[2]];
+            if (g0 == g1 || g1 == g2 || g0 == g2) continue;
+            vecNext.insert(vecNext.end(), corners, corners + 3);
+        }
+        vecResult.swap(vecNext);
+        std::iota(vecRemap.begin(), vecRemap.end(), 0);
+    }
+
+    error = static_cast<float>(std::sqrt(maxError));
+    return vecResult;
+}
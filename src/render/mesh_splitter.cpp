@@ -0,0 +1,62 @@
+#include "render/mesh_splitter.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void MeshSplitter::narrowIndices(const std::vector<uint32_t>& vecIndices, std::vector<uint16_t>& vecIndices16)
+{
+    vecIndices16.resize(vecIndices.size());
+    for (size_t i = 0; i < vecIndices.size(); ++i)
+        vecIndices16[i] = static_cast<uint16_t>(vecIndices[i]);
+}
+
+void MeshSplitter::split(const void* vertices, uint32_t stride, const std::vector<uint32_t>& vecIndices,
+    std::vector<uint8_t>& vecVertices, std::vector<uint16_t>& vecIndices16,
+    std::vector<SubMesh>& vecSubMeshes, size_t maxVertices)
+{
+    if (maxVertices < 3 || maxVertices > MAX_VERTICES) throw std::runtime_error("invalid submesh vertex limit!");
+
+    const uint8_t* pVertices = static_cast<const uint8_t*>(vertices);
+    uint32_t vertexCount = 0;
+    for (uint32_t index : vecIndices) vertexCount = std::max(vertexCount, index + 1);
+
+    vecVertices.clear();
+    vecIndices16.clear();
+    vecIndices16.reserve(vecIndices.size());
+    vecSubMeshes.clear();
+
+    // local index of every source vertex in the current submesh, stamped with
+    // the submesh number so starting a new one does not clear the table
+    std::vector<uint16_t> vecLocal(vertexCount);
+    std::vector<uint32_t> vecOwner(vertexCount, UINT32_MAX);
+    uint32_t owner = 0;
+    size_t localCount = 0;
+    SubMesh current{ 0, 0, 0 };
+
+    for (size_t triangle = 0; triangle + 2 < vecIndices.size(); triangle += 3) {
+        size_t missing = 0;
+        for (size_t corner = 0; corner < 3; ++corner)
+            missing += vecOwner[vecIndices[triangle + corner]] != owner;
+
+        if (localCount + missing > maxVertices) {
+            vecSubMeshes.push_back(current);
+            ++owner;
+            current = SubMesh{ static_cast<uint32_t>(vecIndices16.size()), 0,
+                static_cast<int32_t>(vecVertices.size() / stride) };
+            localCount = 0;
+        }
+
+        for (size_t corner = 0; corner < 3; ++corner) {
+            uint32_t index = vecIndices[triangle + corner];
+            if (vecOwner[index] != owner) {
+                vecOwner[index] = owner;
+                vecLocal[index] = static_cast<uint16_t>(localCount++);
+                vecVertices.insert(vecVertices.end(), pVertices + size_t(index) * stride, pVertices + size_t(index + 1) * stride);
+            }
+            vecIndices16.push_back(vecLocal[index]);
+        }
+        current.indexCount += 3;
+    }
+
+    if (current.indexCount > 0) vecSubMeshes.push_back(current);
+}
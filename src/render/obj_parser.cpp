@@ -0,0 +1,368 @@
+#include "render/obj_parser.h"
+#include "render/parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+    struct ObjChunk {
+        std::vector<float> vertices;
+        std::vector<float> texcoords;
+        std::vector<float> normals;
+        // face corners back to back, faceSizes holds 3 or 4 per face
+        std::vector<ObjIndex> corners;
+        std::vector<uint8_t> faceSizes;
+        // corners whose relative index still needs the counts of earlier chunks
+        std::vector<size_t> vertexFixups;
+        std::vector<size_t> texcoordFixups;
+        std::vector<size_t> normalFixups;
+        std::vector<ObjIndex> indices;
+        bool ok = true;
+    };
+
+    inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+    inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    inline const char* skipSpaces(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p)) ++p;
+        return p;
+    }
+
+    inline const char* tokenEnd(const char* p, const char* end, const char* delims)
+    {
+        while (p < end && !strchr(delims, *p)) ++p;
+        return p;
+    }
+
+    // Same algorithm as tinyobj's tryParseDouble, bit exact results depend on it.
+    bool tryParseDouble(const char* s, const char* sEnd, double* result)
+    {
+        if (s >= sEnd) return false;
+
+        double mantissa = 0.0;
+        int exponent = 0;
+        char sign = '+';
+        const char* curr = s;
+        int read = 0;
+        bool leadingDecimalDots = false;
+
+        if (*curr == '+' || *curr == '-') {
+            sign = *curr;
+            ++curr;
+            if (curr != sEnd && *curr == '.') leadingDecimalDots = true;
+        } else if (*curr == '.') {
+            leadingDecimalDots = true;
+        } else if (!isDigit(*curr)) {
+            return false;
+        }
+
+        if (!leadingDecimalDots) {
+            while (curr != sEnd && isDigit(*curr)) {
+                mantissa *= 10;
+                mantissa += static_cast<int>(*curr - '0');
+                ++curr;
+                ++read;
+            }
+            if (read == 0) return false;
+        }
+
+        if (curr != sEnd && *curr == '.') {
+            ++curr;
+            read = 1;
+            while (curr != sEnd && isDigit(*curr)) {
+                static const double powLut[] = {
+                    1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001,
+                };
+                const int lutEntries = sizeof powLut / sizeof powLut[0];
+                mantissa += static_cast<int>(*curr - '0') *
+                    (read < lutEntries ? powLut[read] : std::pow(10.0, -read));
+                ++read;
+                ++curr;
+            }
+        }
+
+        if (curr != sEnd && (*curr == 'e' || *curr == 'E')) {
+            ++curr;
+            char expSign = '+';
+            if (curr != sEnd && (*curr == '+' || *curr == '-')) {
+                expSign = *curr;
+                ++curr;
+            } else if (curr == sEnd || !isDigit(*curr)) {
+                return false;
+            }
+
+            read = 0;
+            while (curr != sEnd && isDigit(*curr)) {
+                if (exponent > 2147483647 / 10) return false;
+                exponent *= 10;
+                exponent += static_cast<int>(*curr - '0');
+                ++curr;
+                ++read;
+            }
+            exponent *= (expSign == '+' ? 1 : -1);
+            if (read == 0) return false;
+        }
+
+        *result = (sign == '+' ? 1 : -1) *
+            (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+        return true;
+    }
+
+    inline float parseReal(const char*& p, const char* end)
+    {
+        p = skipSpaces(p, end);
+        const char* e = tokenEnd(p, end, " \t\r");
+        double value = 0.0;
+        tryParseDouble(p, e, &value);
+        p = e;
+        return static_cast<float>(value);
+    }
+
+    // atoi limited to the current line
+    inline int parseInt(const char* p, const char* end)
+    {
+        while (p < end && (isSpace(*p) || *p == '\r' || *p == '\v' || *p == '\f')) ++p;
+        bool negative = false;
+        if (p < end && (*p == '+' || *p == '-')) negative = *p++ == '-';
+        int value = 0;
+        while (p < end && isDigit(*p)) value = value * 10 + (*p++ - '0');
+        return negative ? -value : value;
+    }
+
+    // Turns a raw OBJ index into tinyobj's zero based one. Relative indices are
+    // resolved against the chunk-local count and queued for a fixup.
+    inline bool resolveIndex(int raw, size_t localCount, bool allowZero, int& out,
+        std::vector<size_t>& fixups, size_t corner)
+    {
+        if (raw > 0) {
+            out = raw - 1;
+            return true;
+        }
+        if (raw == 0) {
+            out = -1;
+            return allowZero;
+        }
+        out = static_cast<int>(localCount) + raw;
+        fixups.push_back(corner);
+        return true;
+    }
+
+    bool parseCorner(const char*& p, const char* end, ObjChunk& chunk)
+    {
+        const char* delims = "/ \t\r";
+        size_t corner = chunk.corners.size();
+        ObjIndex index;
+
+        if (!resolveIndex(parseInt(p, end), chunk.vertices.size() / 3, false, index.vertex, chunk.vertexFixups, corner))
+            return false;
+        p = tokenEnd(p, end, delims);
+
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p == '/') {
+                ++p;
+                resolveIndex(parseInt(p, end), chunk.normals.size() / 3, true, index.normal, chunk.normalFixups, corner);
+                p = tokenEnd(p, end, delims);
+            } else {
+                resolveIndex(parseInt(p, end), chunk.texcoords.size() / 2, true, index.texcoord, chunk.texcoordFixups, corner);
+                p = tokenEnd(p, end, delims);
+                if (p < end && *p == '/') {
+                    ++p;
+                    resolveIndex(parseInt(p, end), chunk.normals.size() / 3, true, index.normal, chunk.normalFixups, corner);
+                    p = tokenEnd(p, end, delims);
+                }
+            }
+        }
+
+        chunk.corners.push_back(index);
+        return true;
+    }
+
+    void parseChunk(const char* begin, const char* end, ObjChunk& chunk)
+    {
+        const char* line = begin;
+        while (line < end && chunk.ok) {
+            const char* lineEnd = line;
+            while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r') ++lineEnd;
+
+            const char* p = skipSpaces(line, lineEnd);
+            size_t length = lineEnd - p;
+
+            if (length >= 2 && p[0] == 'v' && isSpace(p[1])) {
+                p += 2;
+                chunk.vertices.push_back(parseReal(p, lineEnd));
+                chunk.vertices.push_back(parseReal(p, lineEnd));
+                chunk.vertices.push_back(parseReal(p, lineEnd));
+            } else if (length >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+                p += 3;
+                chunk.texcoords.push_back(parseReal(p, lineEnd));
+                chunk.texcoords.push_back(parseReal(p, lineEnd));
+            } else if (length >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+                p += 3;
+                chunk.normals.push_back(parseReal(p, lineEnd));
+                chunk.normals.push_back(parseReal(p, lineEnd));
+                chunk.normals.push_back(parseReal(p, lineEnd));
+            } else if (length >= 2 && p[0] == 'f' && isSpace(p[1])) {
+                p = skipSpaces(p + 2, lineEnd);
+                size_t first = chunk.corners.size();
+                while (p < lineEnd && *p != '\r') {
+                    if (!parseCorner(p, lineEnd, chunk)) {
+                        chunk.ok = false;
+                        break;
+                    }
+                    while (p < lineEnd && (isSpace(*p) || *p == '\r')) ++p;
+                }
+
+                size_t count = chunk.corners.size() - first;
+                if (count > 4) {
+                    chunk.ok = false;
+                } else if (count >= 3) {
+                    chunk.faceSizes.push_back(static_cast<uint8_t>(count));
+                } else {
+                    // tinyobj drops degenerate faces, drop their fixups too
+                    chunk.corners.resize(first);
+                    auto dropFrom = [first](std::vector<size_t>& fixups) {
+                        while (!fixups.empty() && fixups.back() >= first) fixups.pop_back();
+                    };
+                    dropFrom(chunk.vertexFixups);
+                    dropFrom(chunk.texcoordFixups);
+                    dropFrom(chunk.normalFixups);
+                }
+            }
+
+            line = lineEnd + 1;
+        }
+    }
+
+    // Emits triangles the way tinyobj's exportGroupsToShape does for 3 and 4 corners.
+    void triangulateChunk(ObjChunk& chunk, const std::vector<float>& v)
+    {
+        chunk.indices.reserve(chunk.corners.size() * 3 / 2);
+
+        size_t corner = 0;
+        for (uint8_t faceSize : chunk.faceSizes) {
+            const ObjIndex* c = &chunk.corners[corner];
+            corner += faceSize;
+
+            if (faceSize == 3) {
+                chunk.indices.insert(chunk.indices.end(), c, c + 3);
+                continue;
+            }
+
+            size_t vi0 = size_t(c[0].vertex);
+            size_t vi1 = size_t(c[1].vertex);
+            size_t vi2 = size_t(c[2].vertex);
+            size_t vi3 = size_t(c[3].vertex);
+            if ((3 * vi0 + 2) >= v.size() || (3 * vi1 + 2) >= v.size() ||
+                (3 * vi2 + 2) >= v.size() || (3 * vi3 + 2) >= v.size())
+                continue;
+
+            // split along the shorter diagonal
+            float e02x = v[vi2 * 3 + 0] - v[vi0 * 3 + 0];
+            float e02y = v[vi2 * 3 + 1] - v[vi0 * 3 + 1];
+            float e02z = v[vi2 * 3 + 2] - v[vi0 * 3 + 2];
+            float e13x = v[vi3 * 3 + 0] - v[vi1 * 3 + 0];
+            float e13y = v[vi3 * 3 + 1] - v[vi1 * 3 + 1];
+            float e13z = v[vi3 * 3 + 2] - v[vi1 * 3 + 2];
+            float sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+            float sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+
+            if (sqr02 < sqr13) {
+                chunk.indices.insert(chunk.indices.end(), { c[0], c[1], c[2], c[0], c[2], c[3] });
+            } else {
+                chunk.indices.insert(chunk.indices.end(), { c[0], c[1], c[3], c[1], c[2], c[3] });
+            }
+        }
+    }
+}
+
+bool ObjParser::parseFile(const std::string& path, ObjMesh& mesh, uint32_t threadCount)
+{
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("failed to open file!");
+
+    size_t fileSize = file.tellg();
+    std::vector<char> buffer(fileSize);
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+
+    return parse(buffer.data(), buffer.size(), mesh, threadCount);
+}
+
+bool ObjParser::parse(const char* data, size_t size, ObjMesh& mesh, uint32_t threadCount)
+{
+    if (threadCount == 0) threadCount = defaultThreadCount();
+
+    // a few chunks per thread keeps the tail short when lines are uneven
+    size_t chunkCount = threadCount > 1 ? threadCount * 4 : 1;
+    chunkCount = std::max<size_t>(1, std::min(chunkCount, size / (64 * 1024)));
+
+    std::vector<const char*> vecBounds(chunkCount + 1);
+    vecBounds[0] = data;
+    vecBounds[chunkCount] = data + size;
+    for (size_t i = 1; i < chunkCount; ++i) {
+        const char* p = std::max(vecBounds[i - 1], data + size * i / chunkCount);
+        const char* newline = static_cast<const char*>(memchr(p, '\n', data + size - p));
+        vecBounds[i] = newline ? newline + 1 : data + size;
+    }
+
+    std::vector<ObjChunk> vecChunks(chunkCount);
+    parallelFor(chunkCount, threadCount, [&](size_t i) {
+        parseChunk(vecBounds[i], vecBounds[i + 1], vecChunks[i]);
+    });
+
+    std::vector<size_t> vecVertexBase(chunkCount + 1, 0);
+    std::vector<size_t> vecTexcoordBase(chunkCount + 1, 0);
+    std::vector<size_t> vecNormalBase(chunkCount + 1, 0);
+    for (size_t i = 0; i < chunkCount; ++i) {
+        if (!vecChunks[i].ok) return false;
+        vecVertexBase[i + 1] = vecVertexBase[i] + vecChunks[i].vertices.size();
+        vecTexcoordBase[i + 1] = vecTexcoordBase[i] + vecChunks[i].texcoords.size();
+        vecNormalBase[i + 1] = vecNormalBase[i] + vecChunks[i].normals.size();
+    }
+
+    mesh.vertices.resize(vecVertexBase[chunkCount]);
+    mesh.texcoords.resize(vecTexcoordBase[chunkCount]);
+    mesh.normals.resize(vecNormalBase[chunkCount]);
+
+    std::atomic<bool> ok{true};
+    parallelFor(chunkCount, threadCount, [&](size_t i) {
+        ObjChunk& chunk = vecChunks[i];
+        std::copy(chunk.vertices.begin(), chunk.vertices.end(), mesh.vertices.begin() + vecVertexBase[i]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), mesh.texcoords.begin() + vecTexcoordBase[i]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), mesh.normals.begin() + vecNormalBase[i]);
+
+        // relative indices that still point before this chunk were negative
+        auto fixup = [&](const std::vector<size_t>& fixups, int ObjIndex::*member, size_t base) {
+            for (size_t corner : fixups) {
+                int& index = chunk.corners[corner].*member;
+                index += static_cast<int>(base);
+                if (index < 0) ok = false;
+            }
+        };
+        fixup(chunk.vertexFixups, &ObjIndex::vertex, vecVertexBase[i] / 3);
+        fixup(chunk.texcoordFixups, &ObjIndex::texcoord, vecTexcoordBase[i] / 2);
+        fixup(chunk.normalFixups, &ObjIndex::normal, vecNormalBase[i] / 3);
+    });
+    if (!ok) return false;
+
+    parallelFor(chunkCount, threadCount, [&](size_t i) {
+        triangulateChunk(vecChunks[i], mesh.vertices);
+    });
+
+    std::vector<size_t> vecIndexBase(chunkCount + 1, 0);
+    for (size_t i = 0; i < chunkCount; ++i)
+        vecIndexBase[i + 1] = vecIndexBase[i] + vecChunks[i].indices.size();
+
+    mesh.indices.resize(vecIndexBase[chunkCount]);
+    parallelFor(chunkCount, threadCount, [&](size_t i) {
+        std::copy(vecChunks[i].indices.begin(), vecChunks[i].indices.end(), mesh.indices.begin() + vecIndexBase[i]);
+    });
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#include "render/pipeline_cache.h"
+#include "render/mapped_file.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // VkPipelineCacheHeaderVersionOne, the layout every driver puts first
+    struct PipelineCacheHeader {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    };
+}
+
+void PipelineCache::init(vk::PhysicalDevice physicalDevice, vk::Device device, const std::string& path)
+{
+    m_Device = device;
+    m_Properties = physicalDevice.getProperties();
+    m_Path = path;
+
+    // the driver copies the initial data, the mapping can go right after
+    MappedFile file;
+    vk::PipelineCacheCreateInfo cacheInfo{};
+    if (file.open(path)) {
+        if (isCompatible(file.getData(), file.getSize()))
+            cacheInfo.setInitialDataSize(file.getSize())
+                .setPInitialData(file.getData());
+        else
+            std::cerr << "discarding pipeline cache " << path << " from another device or driver" << std::endl;
+    }
+
+    m_Cache = m_Device.createPipelineCache(cacheInfo);
+    if (!m_Cache) throw std::runtime_error("failed to create pipeline cache!");
+}
+
+void PipelineCache::destroy()
+{
+    if (!m_Cache) return;
+
+    std::vector<uint8_t> vecData = m_Device.getPipelineCacheData(m_Cache);
+    if (!vecData.empty() && !writeFileAtomic(m_Path, { { vecData.data(), vecData.size() } }))
+        std::cerr << "failed to write pipeline cache " << m_Path << std::endl;
+
+    m_Device.destroyPipelineCache(m_Cache);
+    m_Cache = nullptr;
+}
+
+bool PipelineCache::isCompatible(const uint8_t* pData, size_t size) const
+{
+    PipelineCacheHeader header;
+    if (size < sizeof(PipelineCacheHeader)) return false;
+    memcpy(&header, pData, sizeof(PipelineCacheHeader));
+
+    return header.headerSize >= sizeof(PipelineCacheHeader) && header.headerSize <= size &&
+        header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header.vendorID == m_Properties.vendorID &&
+        header.deviceID == m_Properties.deviceID &&
+        memcmp(header.pipelineCacheUUID, m_Properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+}
@@ -17,7 +17,6 @@
 #include <stdexcept>
 #include <limits>
 #include <algorithm>
-#include <unordered_map>
 #include <map>
 #include <set>
 #include <vulkan/vulkan.hpp>
@@ -32,7 +31,6 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <chrono>
 
-#define STB_IMAGE_IMPLEMENTATION
 #include <utils/stb_image.h>
 
 #include <utils/tiny_obj_loader.h>
@@ -44,6 +42,28 @@ void HelloTriangleApplication::run() {
     cleanUp();
 }
 
+void HelloTriangleApplication::runHeadless(uint32_t frameCount, const std::string& readbackPath) {
+    // the readback copies the last rendered frame, without one the image holds nothing
+    if (!readbackPath.empty() && frameCount == 0)
+        throw std::runtime_error("failed to read back, no frame is rendered!");
+
+    m_Headless = true;
+    initVulkan();
+    headlessLoop(frameCount);
+    if (!readbackPath.empty())
+        saveOffscreenImage(readbackPath);
+    cleanUp();
+}
+
+void HelloTriangleApplication::runBenchmark(uint32_t frameCount, uint32_t warmupFrames, bool headless) {
+    m_Headless = headless;
+    if (!m_Headless)
+        initWindow();
+    initVulkan();
+    benchmarkLoop(frameCount, warmupFrames);
+    cleanUp();
+}
+
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
 {
     auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
@@ -61,31 +81,62 @@ void HelloTriangleApplication::initWindow() {
 }
 
 void HelloTriangleApplication::initVulkan() {
+    // the main thread takes part whenever it waits, so one worker fewer than cores
+    m_Jobs.init(defaultThreadCount() - 1);
+
     createInstance();
     setupDebugMessenger();
-    createSurface();
+    if (!m_Headless)
+        createSurface();
     pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createGraphicsPipeline();
-    createCommandPool();
-    createColorResources();
-    createDepthResources();
-    createFramebuffers();
+
+    // the CPU side of both assets runs as jobs while the device is set up, uploads wait for it
+    JobSystem::TaskGraph loadGraph;
+    loadGraph.add([this]() { loadTexture(); });
+    loadGraph.add([this]() { loadModel(); });
+    JobSystem::Counter loadCounter;
+    m_Jobs.run(loadGraph, loadCounter);
+
+    try {
+        createLogicalDevice();
+        createPipelineCache();
+        createAllocator();
+        if (m_Headless)
+            createOffscreenTarget();
+        else
+            createSwapChain();
+        createImageViews();
+        createRenderPass();
+        createDescriptorSetLayout();
+        createGraphicsPipeline();
+        createCommandPool();
+        createUploadManager();
+        createColorResources();
+        createDepthResources();
+        createFramebuffers();
+    } catch (...) {
+        // the jobs point into this frame, they have to finish before it unwinds
+        try { m_Jobs.wait(loadCounter); } catch (...) {}
+        throw;
+    }
+    m_Jobs.wait(loadCounter);
+
     createTextureImage();
     createTextureImageView();
     createTextureSampler();
-    loadModel();
     createVertexBuffer();
     createIndexBuffer();
+    // one submission for every init-time upload, staging is released by poll() once it lands
+    m_UploadManager.flush();
+    releaseMeshData();
     createUniformBuffers();
+    createInstanceBuffer();
+    createGpuCuller();
     createDescriptorPool();
     createDescriptorSets();
     createCommandBuffers();
     createSyncObjects();
+    createQueryPools();
 }
 
 void HelloTriangleApplication::mainLoop() {
@@ -97,6 +148,41 @@ void HelloTriangleApplication::mainLoop() {
     m_Device.waitIdle();
 }
 
+void HelloTriangleApplication::headlessLoop(uint32_t frameCount) {
+    for (uint32_t i = 0; i < frameCount; ++i)
+        drawOffscreenFrame();
+
+    m_Device.waitIdle();
+}
+
+void HelloTriangleApplication::benchmarkLoop(uint32_t frameCount, uint32_t warmupFrames) {
+    m_FrameTimer.reserve(frameCount);
+
+    for (uint32_t i = 0; i < warmupFrames + frameCount; ++i) {
+        if (!m_Headless && glfwWindowShouldClose(m_pWindow)) break;
+
+        // warmup frames pay for pipeline and driver first-use costs, keep them out
+        m_FrameTimer.setEnabled(i >= warmupFrames);
+
+        // alternate between the initial size and half of it, drawFrame picks the change up
+        if (!m_Headless && m_ResizeInterval > 0 && i > 0 && i % m_ResizeInterval == 0) {
+            bool shrink = (i / m_ResizeInterval) % 2 == 1;
+            glfwSetWindowSize(m_pWindow, shrink ? m_Width / 2 : m_Width, shrink ? m_Height / 2 : m_Height);
+        }
+
+        FrameTimer::Scope frameScope(m_FrameTimer, FrameTimer::eFrame);
+        if (m_Headless)
+            drawOffscreenFrame();
+        else {
+            glfwPollEvents();
+            drawFrame();
+        }
+    }
+
+    m_FrameTimer.setEnabled(false);
+    m_Device.waitIdle();
+}
+
 void HelloTriangleApplication::cleanUp() {
     cleanupSwapChain();
 
@@ -104,22 +190,24 @@ void HelloTriangleApplication::cleanUp() {
     m_Device.destroyImageView(m_TextureImageView);
 
     m_Device.destroyImage(m_TextureImage);
-    m_Device.freeMemory(m_TextureImageMemory);
+    m_Allocator.free(m_TextureImageMemory);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-    {
-        m_Device.destroyBuffer(m_vecUniformBuffers[i]);
-        m_Device.freeMemory(m_vecUniformBuffersMemory[i]);
-    }
+    m_Device.destroyBuffer(m_UniformBuffer);
+    m_Allocator.free(m_UniformBufferMemory);
+
+    m_GpuCuller.destroy();
+
+    m_Device.destroyBuffer(m_InstanceBuffer);
+    m_Allocator.free(m_InstanceBufferMemory);
 
     m_Device.destroyDescriptorPool(m_DescriptorPool);
     m_Device.destroyDescriptorSetLayout(m_DescriptorSetLayout);
 
     m_Device.destroyBuffer(m_IndexBuffer);
-    m_Device.freeMemory(m_IndexBufferMemory);
+    m_Allocator.free(m_IndexBufferMemory);
 
     m_Device.destroyBuffer(m_VertexBuffer);
-    m_Device.freeMemory(m_VertexBufferMemory);
+    m_Allocator.free(m_VertexBufferMemory);
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
@@ -128,14 +216,25 @@ void HelloTriangleApplication::cleanUp() {
         m_Device.destroyFence(m_vecInFlightFences[i]);
     }
 
+    m_GpuProfiler.destroy();
+    m_UploadManager.destroy();
+
+    for (vk::CommandPool pool : m_vecSecondaryCommandPools)
+        m_Device.destroyCommandPool(pool);
     m_Device.destroyCommandPool(m_CommandPool);
+    m_PipelineCache.destroy();
+    m_Allocator.destroy();
     m_Device.destroy();
 
     if (m_EnableValidationLayers)
         m_Instance.destroyDebugUtilsMessengerEXT(m_DebugMessenger, nullptr, vk::DispatchLoaderDynamic(m_Instance, vkGetInstanceProcAddr));
 
-    m_Instance.destroySurfaceKHR(m_Surface);
+    if (!m_Headless)
+        m_Instance.destroySurfaceKHR(m_Surface);
     m_Instance.destroy();
+    m_Jobs.shutdown();
+
+    if (m_Headless) return;
 
     glfwDestroyWindow(m_pWindow);
     glfwTerminate();
@@ -160,11 +259,16 @@ bool HelloTriangleApplication::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> HelloTriangleApplication::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensionsRaw;
+    std::vector<const char *> extensions;
+
+    // headless mode never touches GLFW, so no surface extensions are needed
+    if (!m_Headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensionsRaw;
 
-    glfwExtensionsRaw = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    std::vector<const char *> extensions(glfwExtensionsRaw, glfwExtensionsRaw + glfwExtensionCount);
+        glfwExtensionsRaw = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensionsRaw, glfwExtensionsRaw + glfwExtensionCount);
+    }
 
     if (m_EnableValidationLayers)
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -172,6 +276,11 @@ std::vector<const char *> HelloTriangleApplication::getRequiredExtensions() {
     return extensions;
 }
 
+std::vector<const char *> HelloTriangleApplication::getRequiredDeviceExtensions() {
+    if (m_Headless) return {};
+    return m_vecDeviceExtensions;
+}
+
 VKAPI_ATTR VkBool32 VKAPI_CALL HelloTriangleApplication::debugCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
     VkDebugUtilsMessageTypeFlagsEXT messageTypes,
@@ -249,6 +358,8 @@ void HelloTriangleApplication::createLogicalDevice()
         indices.graphicsFamily.value(),
         indices.presentFamily.value()
     };
+    if (indices.transferFamily)
+        uniqueQueueFamilies.insert(indices.transferFamily.value());
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -259,14 +370,20 @@ void HelloTriangleApplication::createLogicalDevice()
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
+    vk::PhysicalDeviceFeatures supportedFeatures = m_PhysicalDevice.getFeatures();
     vk::PhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.setSamplerAnisotropy(true)
-        .setSampleRateShading(true);
+        .setSampleRateShading(true)
+        .setTextureCompressionBC(supportedFeatures.textureCompressionBC)
+        .setMultiDrawIndirect(supportedFeatures.multiDrawIndirect)
+        .setDrawIndirectFirstInstance(supportedFeatures.drawIndirectFirstInstance);
+
+    auto deviceExtensions = getRequiredDeviceExtensions();
 
     vk::DeviceCreateInfo createInfo{};
     createInfo.setQueueCreateInfos(queueCreateInfos)
     .setPEnabledFeatures(&deviceFeatures)
-    .setPEnabledExtensionNames(m_vecDeviceExtensions);
+    .setPEnabledExtensionNames(deviceExtensions);
 
     if (m_EnableValidationLayers)
         createInfo.setPEnabledLayerNames(m_vecValidationLayers);
@@ -277,6 +394,13 @@ void HelloTriangleApplication::createLogicalDevice()
 
     m_GraphicsQueue = m_Device.getQueue(indices.graphicsFamily.value(), 0);
     m_PresentQueue = m_Device.getQueue(indices.presentFamily.value(), 0);
+    if (indices.transferFamily)
+        m_TransferQueue = m_Device.getQueue(indices.transferFamily.value(), 0);
+}
+
+void HelloTriangleApplication::createAllocator()
+{
+    m_Allocator.init(m_PhysicalDevice, m_Device);
 }
 
 void HelloTriangleApplication::createSwapChain()
@@ -315,16 +439,39 @@ void HelloTriangleApplication::createSwapChain()
             .setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque)
             .setPresentMode(presentMode)
             .setClipped(true)
-            .setOldSwapchain(nullptr);
+            .setOldSwapchain(m_SwapChain);
 
+    // on a resize the old swapchain is handed over, the presentation engine can reuse its resources
+    vk::SwapchainKHR oldSwapChain = m_SwapChain;
     m_SwapChain = m_Device.createSwapchainKHR(createInfo);
     if (!m_SwapChain)   throw std::runtime_error("failed to create swap chain!");
+    if (oldSwapChain) m_Device.destroySwapchainKHR(oldSwapChain);
 
     m_vecSwapChainImages = m_Device.getSwapchainImagesKHR(m_SwapChain);
     m_SwapChainImageFormat = surfaceFormat.format;
     m_SwapChainExtent = extent;
 }
 
+void HelloTriangleApplication::createOffscreenTarget()
+{
+    // one resolve target per frame in flight stands in for the swapchain images
+    m_SwapChainImageFormat = findSupportedFormat(
+        { vk::Format::eR8G8B8A8Srgb, vk::Format::eB8G8R8A8Srgb },
+        vk::ImageTiling::eOptimal,
+        vk::FormatFeatureFlagBits::eColorAttachment);
+    m_SwapChainExtent = vk::Extent2D(m_Width, m_Height);
+
+    m_vecSwapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+    m_vecOffscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        createImage(m_SwapChainExtent.width, m_SwapChainExtent.height, 1,
+            vk::SampleCountFlagBits::e1, m_SwapChainImageFormat, vk::ImageTiling::eOptimal,
+            vk::ImageUsageFlagBits::eColorAttachment |
+            vk::ImageUsageFlagBits::eTransferSrc,
+            vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryUsage::eGpuOnly,
+            m_vecSwapChainImages[i], m_vecOffscreenImagesMemory[i]);
+}
+
 void HelloTriangleApplication::createImageViews()
 {
     m_vecSwapChainImageViews.clear();
@@ -352,7 +499,7 @@ void HelloTriangleApplication::createRenderPass()
         .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
         .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
         .setInitialLayout(vk::ImageLayout::eUndefined)
-        .setFinalLayout(vk::ImageLayout::ePresentSrcKHR);
+        .setFinalLayout(m_Headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR);
 
     vk::AttachmentReference colorAttachmentResolveRef{};
     colorAttachmentResolveRef.setAttachment(2)
@@ -405,7 +552,7 @@ void HelloTriangleApplication::createDescriptorSetLayout()
 {
     vk::DescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.setBinding(0)
-        .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+        .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
         .setDescriptorCount(1)
         .setStageFlags(vk::ShaderStageFlagBits::eVertex);
         // .setPImmutableSamplers(nullptr);    // Optional
@@ -417,8 +564,20 @@ void HelloTriangleApplication::createDescriptorSetLayout()
         .setStageFlags(vk::ShaderStageFlagBits::eFragment)
         .setPImmutableSamplers(nullptr);
 
-    std::array<vk::DescriptorSetLayoutBinding, 2> bindings = 
-    {   uboLayoutBinding, samplerLayoutBinding };
+    vk::DescriptorSetLayoutBinding instanceLayoutBinding{};
+    instanceLayoutBinding.setBinding(2)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+        .setStageFlags(vk::ShaderStageFlagBits::eVertex);
+
+    vk::DescriptorSetLayoutBinding visibleLayoutBinding{};
+    visibleLayoutBinding.setBinding(3)
+        .setDescriptorCount(1)
+        .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+        .setStageFlags(vk::ShaderStageFlagBits::eVertex);
+
+    std::array<vk::DescriptorSetLayoutBinding, 4> bindings = 
+    {   uboLayoutBinding, samplerLayoutBinding, instanceLayoutBinding, visibleLayoutBinding };
 
     vk::DescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.setBindings(bindings);
@@ -428,6 +587,11 @@ void HelloTriangleApplication::createDescriptorSetLayout()
         throw std::runtime_error("failed to create descriptor set layout!");
 }
 
+void HelloTriangleApplication::createPipelineCache()
+{
+    m_PipelineCache.init(m_PhysicalDevice, m_Device, PIPELINE_CACHE_PATH);
+}
+
 void HelloTriangleApplication::createGraphicsPipeline()
 {
     auto vertShaderCode = readFile("./src/shaders/vert.spv");
@@ -450,7 +614,15 @@ void HelloTriangleApplication::createGraphicsPipeline()
         { vertShaderStageInfo, fragShaderStageInfo };
 
     auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    std::vector<vk::VertexInputAttributeDescription> attributeDescriptions;
+    if (VERTEX_FORMAT == VertexFormat::eCompact) {
+        bindingDescription = CompactVertex::getBindingDescription();
+        auto compactAttributes = CompactVertex::getAttributeDescriptions();
+        attributeDescriptions.assign(compactAttributes.begin(), compactAttributes.end());
+    } else {
+        auto floatAttributes = Vertex::getAttributeDescriptions();
+        attributeDescriptions.assign(floatAttributes.begin(), floatAttributes.end());
+    }
 
     vk::PipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.setVertexBindingDescriptions(bindingDescription)
@@ -460,21 +632,10 @@ void HelloTriangleApplication::createGraphicsPipeline()
     inputAssembly.setTopology(vk::PrimitiveTopology::eTriangleList)
     .setPrimitiveRestartEnable(false);
 
-    vk::Viewport viewport{};
-    viewport.setX(0.0f)
-    .setY(0.0f)
-    .setWidth(m_SwapChainExtent.width)
-    .setHeight(m_SwapChainExtent.height)
-    .setMinDepth(0.0f)
-    .setMaxDepth(1.0f);
-
-    vk::Rect2D scissor{};
-    scissor.setOffset(vk::Offset2D(0, 0))
-        .setExtent(m_SwapChainExtent);
-
+    // viewport and scissor are dynamic, the pipeline survives a resize
     vk::PipelineViewportStateCreateInfo viewportState;
-    viewportState.setViewports(viewport)
-    .setScissors(scissor);
+    viewportState.setViewportCount(1)
+    .setScissorCount(1);
 
     vk::PipelineRasterizationStateCreateInfo rasterizer{};
     rasterizer.setDepthClampEnable(false)
@@ -533,14 +694,20 @@ void HelloTriangleApplication::createGraphicsPipeline()
 
     std::vector<vk::DynamicState> dynamicStates {
         vk::DynamicState::eViewport,
-        vk::DynamicState::eLineWidth
+        vk::DynamicState::eScissor
     };
     vk::PipelineDynamicStateCreateInfo dynamicState{};
     dynamicState.setDynamicStates(dynamicStates);
 
+    // visibleBase for GpuCuller::draw
+    vk::PushConstantRange pushConstantRange{};
+    pushConstantRange.setStageFlags(vk::ShaderStageFlagBits::eVertex)
+        .setOffset(0)
+        .setSize(sizeof(uint32_t));
+
     vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.setSetLayouts(m_DescriptorSetLayout)    // Optional
-        .setPushConstantRanges({});     // Optional
+        .setPushConstantRanges(pushConstantRange);
     
     m_PipelineLayout = m_Device.createPipelineLayout(pipelineLayoutInfo);
     if (!m_PipelineLayout)  throw std::runtime_error("failed to create pipeline layout!");
@@ -554,14 +721,14 @@ void HelloTriangleApplication::createGraphicsPipeline()
         .setPMultisampleState(&multisampling)
         .setPDepthStencilState(&depthStencil)
         .setPColorBlendState(&colorBlending)
-        .setPDynamicState(nullptr)      // Optional
+        .setPDynamicState(&dynamicState)
         .setLayout(m_PipelineLayout)
         .setRenderPass(m_RenderPass)
         .setSubpass(0)
         .setBasePipelineHandle(nullptr) // OPtional
         .setBasePipelineIndex(-1);  // Optional
 
-    auto pipeline  = m_Device.createGraphicsPipeline(nullptr, pipelineInfo);
+    auto pipeline  = m_Device.createGraphicsPipeline(m_PipelineCache.get(), pipelineInfo);
     if (pipeline.result != vk::Result::eSuccess)
         throw std::runtime_error("failed to create graphics pipeline!");
     m_GraphicsPipeline = pipeline.value;
@@ -599,6 +766,26 @@ void HelloTriangleApplication::createCommandPool()
 
     m_CommandPool = m_Device.createCommandPool(poolInfo);
     if (!m_CommandPool) throw std::runtime_error("failed to create command pool!");
+
+    // pools are only used from one thread at a time and reset whole, never per buffer
+    if (m_RecordThreadCount == 0) m_RecordThreadCount = defaultThreadCount();
+    vk::CommandPoolCreateInfo secondaryPoolInfo{};
+    secondaryPoolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+        .setQueueFamilyIndex(queueFamilyIndices.graphicsFamily.value());
+    m_vecSecondaryCommandPools.resize(MAX_FRAMES_IN_FLIGHT * m_RecordThreadCount);
+    for (vk::CommandPool& pool : m_vecSecondaryCommandPools) {
+        pool = m_Device.createCommandPool(secondaryPoolInfo);
+        if (!pool) throw std::runtime_error("failed to create secondary command pool!");
+    }
+    m_vecRecordedJobCounts.assign(MAX_FRAMES_IN_FLIGHT, 0);
+}
+
+void HelloTriangleApplication::createUploadManager()
+{
+    QueueFamilyIndices indices = findQueueFamilies(m_PhysicalDevice);
+    m_UploadManager.init(m_Device, &m_Allocator,
+        indices.graphicsFamily.value(), m_GraphicsQueue,
+        indices.transferFamily, m_TransferQueue, indices.transferImageGranularity, STAGING_RING_SIZE);
 }
 
 void HelloTriangleApplication::createColorResources()
@@ -614,6 +801,7 @@ void HelloTriangleApplication::createColorResources()
         vk::ImageUsageFlagBits::eTransientAttachment |
         vk::ImageUsageFlagBits::eColorAttachment,
         vk::MemoryPropertyFlagBits::eDeviceLocal,
+        MemoryUsage::eTransient,
         m_ColorImage,
         m_ColorImageMemory);
     m_ColorImageView = createImageView(m_ColorImage, colorFormat, vk::ImageAspectFlagBits::eColor, 1);
@@ -625,63 +813,108 @@ void HelloTriangleApplication::createDepthResources()
     createImage(m_SwapChainExtent.width, m_SwapChainExtent.height, 1,
         m_MSAASamples, depthFormat, vk::ImageTiling::eOptimal,
         vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::MemoryPropertyFlagBits::eDeviceLocal,
-        m_DepthImage, m_DepthImageMemory);
+        MemoryUsage::eGpuOnly, m_DepthImage, m_DepthImageMemory);
 
     m_DepthImageView = createImageView(m_DepthImage, depthFormat, vk::ImageAspectFlagBits::eDepth, 1);
 
-    transitionImageLayout(m_DepthImage, depthFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal, 1);
+    vk::Image depthImage = m_DepthImage;
+    m_UploadManager.recordGraphics([this, depthImage, depthFormat](vk::CommandBuffer commandBuffer) {
+        transitionImageLayout(commandBuffer, depthImage, depthFormat,
+            vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal, 1);
+    });
 }
 
-void HelloTriangleApplication::createTextureImage()
+void HelloTriangleApplication::loadTexture()
 {
-    int texWidth, texHeight, texChannels;
-    // stbi_uc* pixels = stbi_load("./src/texture/redPattern.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    vk::DeviceSize imageSize = texWidth * texHeight * 4;
-
-    m_MipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-
-    if (!pixels)
-        throw std::runtime_error("failed to load texture image!");
+    // BC needs the device feature, RGBA8 is the fallback every device samples
+    bool textureCompressionBC = m_PhysicalDevice.getFeatures().textureCompressionBC;
+    std::vector<vk::Format> vecCandidates;
+    if (textureCompressionBC)
+        vecCandidates = { vk::Format::eBc7SrgbBlock, vk::Format::eBc1RgbSrgbBlock };
+    vecCandidates.push_back(vk::Format::eR8G8B8A8Srgb);
+
+    vk::FormatFeatureFlags features = vk::FormatFeatureFlagBits::eSampledImage |
+        vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    m_TextureFormat = findSupportedFormat(vecCandidates, vk::ImageTiling::eOptimal, features);
+
+    // a cache baked offline is taken as is in anything texenc writes, --linear and bc3 included
+    std::vector<vk::Format> vecCacheFormats;
+    if (textureCompressionBC)
+        vecCacheFormats = {
+            vk::Format::eBc7SrgbBlock, vk::Format::eBc7UnormBlock,
+            vk::Format::eBc3SrgbBlock, vk::Format::eBc3UnormBlock,
+            vk::Format::eBc1RgbSrgbBlock, vk::Format::eBc1RgbUnormBlock };
+    vecCacheFormats.push_back(vk::Format::eR8G8B8A8Srgb);
+    vecCacheFormats.push_back(vk::Format::eR8G8B8A8Unorm);
+
+    bool cached = false;
+    for (vk::Format candidate : vecCacheFormats) {
+        vk::FormatProperties properties = m_PhysicalDevice.getFormatProperties(candidate);
+        if ((properties.optimalTilingFeatures & features) != features) continue;
+        if (m_TextureCache.load(TEXTURE_CACHE_PATH, TEXTURE_PATH, static_cast<uint32_t>(candidate))) {
+            m_TextureFormat = candidate;
+            cached = true;
+            break;
+        }
+    }
 
-    vk::Buffer stagingBuffer;
-    vk::DeviceMemory stagingBufferMemory;
+    std::vector<uint8_t>& vecTexels = m_vecTexels;
+    TextureView& texture = m_Texture;
 
-    createBuffer(imageSize, vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostVisible |
-        vk::MemoryPropertyFlagBits::eHostCoherent,
-        stagingBuffer, stagingBufferMemory);
+    if (cached) {
+        texture = m_TextureCache.getView();
+    } else {
+        int texWidth, texHeight, texChannels;
+        // stbi_uc* pixels = stbi_load("./src/texture/redPattern.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+        stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+        if (!pixels)
+            throw std::runtime_error("failed to load texture image!");
+
+        vecTexels = TextureCache::buildMipChain(pixels, texWidth, texHeight, true, texture.levels, defaultThreadCount());
+        stbi_image_free(pixels);
+
+        if (m_TextureFormat != vk::Format::eR8G8B8A8Srgb) {
+            BlockFormat blockFormat = m_TextureFormat == vk::Format::eBc7SrgbBlock ? BlockFormat::eBC7 : BlockFormat::eBC1;
+            std::vector<TextureLevel> vecSourceLevels;
+            vecSourceLevels.swap(texture.levels);
+            vecTexels = BlockEncoder::encodeMipChain(blockFormat, vecTexels.data(), vecSourceLevels,
+                texture.levels, defaultThreadCount());
+        }
 
-    void* data;
-    const auto&_ = m_Device.mapMemory(stagingBufferMemory, 0, imageSize, vk::MemoryMapFlags{0}, &data);
-    memcpy(data, pixels, imageSize);
-    m_Device.unmapMemory(stagingBufferMemory);
+        texture.format = static_cast<uint32_t>(m_TextureFormat);
+        texture.pData = vecTexels.data();
+        texture.dataSize = vecTexels.size();
+        if (!TextureCache::store(TEXTURE_CACHE_PATH, TEXTURE_PATH, texture))
+            std::cerr << "failed to write texture cache " << TEXTURE_CACHE_PATH << std::endl;
+    }
+}
 
-    stbi_image_free(pixels);
+void HelloTriangleApplication::createTextureImage()
+{
+    const TextureView& texture = m_Texture;
+    m_MipLevels = static_cast<uint32_t>(texture.levels.size());
 
-    createImage(texWidth, texHeight, m_MipLevels,
+    createImage(texture.levels[0].width, texture.levels[0].height, m_MipLevels,
         vk::SampleCountFlagBits::e1,
-        vk::Format::eR8G8B8A8Srgb, vk::ImageTiling::eOptimal,
-        vk::ImageUsageFlagBits::eTransferSrc |
+        m_TextureFormat, vk::ImageTiling::eOptimal,
         vk::ImageUsageFlagBits::eTransferDst |
         vk::ImageUsageFlagBits::eSampled,
-        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryUsage::eGpuOnly,
         m_TextureImage, m_TextureImageMemory);
 
-    transitionImageLayout(m_TextureImage, vk::Format::eR8G8B8A8Srgb, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, m_MipLevels);
-    copyBufferToImage(stagingBuffer, m_TextureImage, texWidth, texHeight);
-
-    // transitionImageLayout(m_TextureImage, vk::Format::eR8G8B8A8Srgb, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, m_MipLevels);
-
-    generateMipmaps(m_TextureImage, vk::Format::eR8G8B8A8Srgb, texWidth, texHeight, m_MipLevels);
-
-    m_Device.destroyBuffer(stagingBuffer);
-    m_Device.freeMemory(stagingBufferMemory);
+    // every level is already in the staging ring once this returns
+    bool uncompressed = m_TextureFormat == vk::Format::eR8G8B8A8Srgb || m_TextureFormat == vk::Format::eR8G8B8A8Unorm;
+    uint32_t blockExtent = uncompressed ? 1 : BlockEncoder::BLOCK_EXTENT;
+    m_UploadManager.uploadImage(m_TextureImage, texture.pData, texture.levels, blockExtent);
+    m_TextureCache.close();
+    m_Texture = TextureView{};
+    std::vector<uint8_t>().swap(m_vecTexels);
 }
 
 void HelloTriangleApplication::createTextureImageView()
 {
-    m_TextureImageView = createImageView(m_TextureImage, vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor, m_MipLevels);
+    m_TextureImageView = createImageView(m_TextureImage, m_TextureFormat, vk::ImageAspectFlagBits::eColor, m_MipLevels);
 }
 
 void HelloTriangleApplication::createTextureSampler()
@@ -713,124 +946,343 @@ void HelloTriangleApplication::createTextureSampler()
 
 void HelloTriangleApplication::loadModel()
 {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+    MeshLayout layout = getMeshLayout();
+    MeshBuildSettings settings{ LOD_LEVEL_COUNT, SPLIT_LARGE_MESHES, OPTIMIZE_OVERDRAW };
+    if (m_MeshCache.load(MESH_CACHE_PATH, MODEL_PATH, layout, settings)) {
+        m_Mesh = m_MeshCache.getView();
+        return;
+    }
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
-        throw std::runtime_error(warn + err);
+    ObjMesh mesh;
+    if (!ObjParser::parseFile(MODEL_PATH, mesh))
+    {
+        // n-gons and indices the fast path rejects go through tinyobj
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warn, err;
+
+        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
+            throw std::runtime_error(warn + err);
+
+        mesh.vertices = std::move(attrib.vertices);
+        mesh.texcoords = std::move(attrib.texcoords);
+        mesh.normals = std::move(attrib.normals);
+        mesh.indices.clear();
+        for (const auto& shape : shapes)
+            for (const auto& index : shape.mesh.indices)
+                mesh.indices.push_back({ index.vertex_index, index.texcoord_index, index.normal_index });
+    }
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+    std::vector<Vertex> corners(mesh.indices.size());
+    for (size_t i = 0; i < mesh.indices.size(); ++i) {
+        const ObjIndex& index = mesh.indices[i];
+        Vertex& vertex = corners[i];
 
-    for(const auto& shape : shapes)
-    {
-        for(const auto& index : shape.mesh.indices) {
-            Vertex vertex{};
+        vertex.pos = {
+            mesh.vertices[3 * index.vertex + 0],
+            mesh.vertices[3 * index.vertex + 1],
+            mesh.vertices[3 * index.vertex + 2]
+        };
 
-            vertex.pos = {
-                attrib.vertices[3 * index.vertex_index + 0],
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
+        vertex.texCoord = {
+            mesh.texcoords[2 * index.texcoord + 0],
+            1.0 - mesh.texcoords[2 * index.texcoord + 1]
+        };
 
-            vertex.texCoord = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0 - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
+        vertex.color = { 1.0f, 1.0f, 1.0f };
+    }
 
-            vertex.color = { 1.0f, 1.0f, 1.0f };
+    // Vertex is tightly packed floats, weld compares them one by one
+    static_assert(sizeof(Vertex) % sizeof(float) == 0, "Vertex must be made of floats");
+    std::vector<uint32_t> firstOccurrences;
+    VertexDedup::weld(reinterpret_cast<const float*>(corners.data()), sizeof(Vertex) / sizeof(float),
+        corners.size(), m_Indices, firstOccurrences, defaultThreadCount());
 
-            if (uniqueVertices.count(vertex) == 0) {
-                uniqueVertices[vertex] = m_Vertices.size();
-                m_Vertices.emplace_back(vertex);
-            }
+    m_Vertices.reserve(firstOccurrences.size());
+    for (uint32_t corner : firstOccurrences)
+        m_Vertices.emplace_back(corners[corner]);
+
+    optimizeMesh();
+    buildLodChain();
+
+    m_Mesh.pVertices = m_Vertices.data();
+    m_Mesh.vertexCount = m_Vertices.size();
+    m_Mesh.pIndices = m_Indices.data();
+    m_Mesh.indexCount = m_Indices.size();
+    m_Mesh.indexSize = sizeof(uint32_t);
+    m_Mesh.bounds = MeshCache::computeBounds(m_Vertices.data(), m_Vertices.size(), sizeof(Vertex), offsetof(Vertex, pos));
+
+    if (VERTEX_FORMAT == VertexFormat::eCompact)
+        quantizeVertices();
+
+    buildIndexBuffer16(layout.vertexStride);
+
+    if (!MeshCache::store(MESH_CACHE_PATH, MODEL_PATH, layout, settings, m_Mesh))
+        std::cerr << "failed to write mesh cache " << MESH_CACHE_PATH << std::endl;
+}
+
+void HelloTriangleApplication::optimizeMesh()
+{
+    MeshOptimizer::optimizeVertexCache(m_Indices, m_Vertices.size());
+    if (OPTIMIZE_OVERDRAW) {
+        const float* pPositions = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(m_Vertices.data()) + offsetof(Vertex, pos));
+        MeshOptimizer::optimizeOverdraw(m_Indices, pPositions, sizeof(Vertex), m_Vertices.size());
+    }
+    m_Vertices.resize(MeshOptimizer::optimizeVertexFetch(m_Indices, m_Vertices.data(), sizeof(Vertex), m_Vertices.size()));
+}
+
+void HelloTriangleApplication::buildLodChain()
+{
+    // one 32-bit submesh per level for now, buildIndexBuffer16 narrows or splits them
+    m_Mesh.subMeshes = { { 0, static_cast<uint32_t>(m_Indices.size()), 0 } };
+    m_Mesh.lods = { { 0.0f, 0, 1 } };
+
+    // every level is simplified from the previous one, so errors add up
+    const float* pPositions = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(m_Vertices.data()) + offsetof(Vertex, pos));
+    std::vector<uint32_t> vecLevelIndices(m_Indices);
+    float error = 0.0f;
+    while (m_Mesh.lods.size() < LOD_LEVEL_COUNT) {
+        float levelError = 0.0f;
+        std::vector<uint32_t> vecCoarser = MeshSimplifier::simplify(vecLevelIndices, pPositions, sizeof(Vertex),
+            m_Vertices.size(), vecLevelIndices.size() / 2, levelError);
+        // borders and seams can stall the simplifier, a level that barely shrinks is not worth its memory
+        if (vecCoarser.empty() || vecCoarser.size() * 10 > vecLevelIndices.size() * 9) break;
+
+        MeshOptimizer::optimizeVertexCache(vecCoarser, m_Vertices.size());
+        error += levelError;
+        m_Mesh.lods.push_back({ error, static_cast<uint32_t>(m_Mesh.subMeshes.size()), 1 });
+        m_Mesh.subMeshes.push_back({ static_cast<uint32_t>(m_Indices.size()), static_cast<uint32_t>(vecCoarser.size()), 0 });
+        m_Indices.insert(m_Indices.end(), vecCoarser.begin(), vecCoarser.end());
+        vecLevelIndices.swap(vecCoarser);
+    }
+}
+
+void HelloTriangleApplication::quantizeVertices()
+{
+    if (m_Vertices.empty()) return;
+
+    float texCoordMin[2] = { m_Vertices[0].texCoord.x, m_Vertices[0].texCoord.y };
+    float texCoordMax[2] = { texCoordMin[0], texCoordMin[1] };
+    for (const Vertex& vertex : m_Vertices) {
+        for (int axis = 0; axis < 2; ++axis) {
+            texCoordMin[axis] = std::min(texCoordMin[axis], vertex.texCoord[axis]);
+            texCoordMax[axis] = std::max(texCoordMax[axis], vertex.texCoord[axis]);
+        }
+    }
+
+    // snorm covers [-1, 1] around the bounds center, unorm [0, 1] from the UV minimum.
+    // A flat axis keeps a scale of 1 so it still decodes to its single value.
+    MeshDequantize& dequantize = m_Mesh.dequantize;
+    for (int axis = 0; axis < 3; ++axis) {
+        float halfExtent = (m_Mesh.bounds.max[axis] - m_Mesh.bounds.min[axis]) * 0.5f;
+        dequantize.positionScale[axis] = halfExtent > 0.0f ? halfExtent : 1.0f;
+        dequantize.positionOffset[axis] = m_Mesh.bounds.min[axis] + halfExtent;
+    }
+    for (int axis = 0; axis < 2; ++axis) {
+        float extent = texCoordMax[axis] - texCoordMin[axis];
+        dequantize.texCoordScale[axis] = extent > 0.0f ? extent : 1.0f;
+        dequantize.texCoordOffset[axis] = texCoordMin[axis];
+    }
+
+    m_vecCompactVertices.resize(m_Vertices.size());
+    for (size_t i = 0; i < m_Vertices.size(); ++i) {
+        CompactVertex& compact = m_vecCompactVertices[i];
+        for (int axis = 0; axis < 3; ++axis) {
+            float normalized = (m_Vertices[i].pos[axis] - dequantize.positionOffset[axis]) / dequantize.positionScale[axis];
+            compact.pos[axis] = static_cast<int16_t>(std::lround(std::clamp(normalized, -1.0f, 1.0f) * 32767.0f));
+        }
+        compact.pos[3] = 0;
+        for (int axis = 0; axis < 2; ++axis) {
+            float normalized = (m_Vertices[i].texCoord[axis] - dequantize.texCoordOffset[axis]) / dequantize.texCoordScale[axis];
+            compact.texCoord[axis] = static_cast<uint16_t>(std::lround(std::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+        }
+    }
 
-            m_Indices.emplace_back(uniqueVertices[vertex]);
+    m_Mesh.pVertices = m_vecCompactVertices.data();
+}
+
+void HelloTriangleApplication::buildIndexBuffer16(uint32_t vertexStride)
+{
+    if (MeshSplitter::fitsUint16(m_Mesh.vertexCount)) {
+        MeshSplitter::narrowIndices(m_Indices, m_vecIndices16);
+    } else if (SPLIT_LARGE_MESHES) {
+        // levels are split one by one so each keeps a contiguous run of submeshes
+        std::vector<SubMesh> vecLevels;
+        vecLevels.swap(m_Mesh.subMeshes);
+        m_vecSplitVertices.clear();
+        m_vecIndices16.clear();
+        std::vector<uint8_t> vecVertices;
+        std::vector<uint16_t> vecIndices16;
+        std::vector<SubMesh> vecSubMeshes;
+        for (MeshLod& lod : m_Mesh.lods) {
+            const SubMesh& level = vecLevels[lod.firstSubMesh];
+            std::vector<uint32_t> vecLevelIndices(m_Indices.begin() + level.firstIndex,
+                m_Indices.begin() + level.firstIndex + level.indexCount);
+            MeshSplitter::split(m_Mesh.pVertices, vertexStride, vecLevelIndices, vecVertices, vecIndices16, vecSubMeshes);
+
+            uint32_t firstIndex = static_cast<uint32_t>(m_vecIndices16.size());
+            int32_t vertexOffset = static_cast<int32_t>(m_vecSplitVertices.size() / vertexStride);
+            lod.firstSubMesh = static_cast<uint32_t>(m_Mesh.subMeshes.size());
+            lod.subMeshCount = static_cast<uint32_t>(vecSubMeshes.size());
+            for (const SubMesh& subMesh : vecSubMeshes)
+                m_Mesh.subMeshes.push_back({ firstIndex + subMesh.firstIndex, subMesh.indexCount, vertexOffset + subMesh.vertexOffset });
+            m_vecSplitVertices.insert(m_vecSplitVertices.end(), vecVertices.begin(), vecVertices.end());
+            m_vecIndices16.insert(m_vecIndices16.end(), vecIndices16.begin(), vecIndices16.end());
         }
+        m_Mesh.pVertices = m_vecSplitVertices.data();
+        m_Mesh.vertexCount = m_vecSplitVertices.size() / vertexStride;
+    } else {
+        return;
+    }
+
+    m_Mesh.pIndices = m_vecIndices16.data();
+    m_Mesh.indexCount = m_vecIndices16.size();
+    m_Mesh.indexSize = sizeof(uint16_t);
+}
+
+MeshLayout HelloTriangleApplication::getMeshLayout() const
+{
+    MeshLayout layout;
+    if (VERTEX_FORMAT == VertexFormat::eCompact) {
+        layout.vertexStride = sizeof(CompactVertex);
+        for (const auto& attribute : CompactVertex::getAttributeDescriptions())
+            layout.attributes.push_back({ attribute.location, static_cast<uint32_t>(attribute.format), attribute.offset });
+    } else {
+        layout.vertexStride = sizeof(Vertex);
+        for (const auto& attribute : Vertex::getAttributeDescriptions())
+            layout.attributes.push_back({ attribute.location, static_cast<uint32_t>(attribute.format), attribute.offset });
     }
+    return layout;
+}
+
+void HelloTriangleApplication::releaseMeshData()
+{
+    // staging already holds copies, only the counts and bounds are still needed
+    m_MeshCache.close();
+    std::vector<Vertex>().swap(m_Vertices);
+    std::vector<CompactVertex>().swap(m_vecCompactVertices);
+    std::vector<uint8_t>().swap(m_vecSplitVertices);
+    std::vector<uint32_t>().swap(m_Indices);
+    std::vector<uint16_t>().swap(m_vecIndices16);
+    m_Mesh.pVertices = nullptr;
+    m_Mesh.pIndices = nullptr;
 }
 
 void HelloTriangleApplication::createVertexBuffer()
 {
-    vk::DeviceSize bufferSize = sizeof(Vertex) * m_Vertices.size();
-    
-    vk::Buffer stagingBuffer;
-    vk::DeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostVisible |
-        vk::MemoryPropertyFlagBits::eHostCoherent,
-        stagingBuffer, stagingBufferMemory);
-    
-    void* data;
-    const auto&_ = m_Device.mapMemory(stagingBufferMemory, 0, bufferSize, vk::MemoryMapFlags{0}, &data);
-    memcpy(data, m_Vertices.data(), bufferSize);
-    m_Device.unmapMemory(stagingBufferMemory);
+    vk::DeviceSize bufferSize = getMeshLayout().vertexStride * m_Mesh.vertexCount;
 
     createBuffer(bufferSize,
         vk::BufferUsageFlagBits::eTransferDst |
         vk::BufferUsageFlagBits::eVertexBuffer,
-        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryUsage::eGpuOnly,
         m_VertexBuffer, m_VertexBufferMemory);
-    
-    copyBuffer(stagingBuffer, m_VertexBuffer, bufferSize);
 
-    m_Device.destroyBuffer(stagingBuffer);
-    m_Device.freeMemory(stagingBufferMemory);
+    m_UploadManager.uploadBuffer(m_VertexBuffer, m_Mesh.pVertices, bufferSize, 0,
+        vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead);
 }
 
 void HelloTriangleApplication::createIndexBuffer()
 {
-    vk::DeviceSize bufferSize = sizeof(m_Indices[0]) * m_Indices.size();
-
-    vk::Buffer stagingBuffer;
-    vk::DeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, 
-        vk::BufferUsageFlagBits::eTransferSrc,
-        vk::MemoryPropertyFlagBits::eHostVisible |
-        vk::MemoryPropertyFlagBits::eHostCoherent,
-        stagingBuffer, stagingBufferMemory);
-    
-    void* data;
-    const auto&_ = m_Device.mapMemory(stagingBufferMemory, 0, bufferSize, vk::MemoryMapFlags{0}, &data);
-    memcpy(data, m_Indices.data(), bufferSize);
-    m_Device.unmapMemory(stagingBufferMemory);
+    vk::DeviceSize bufferSize = m_Mesh.indexSize * m_Mesh.indexCount;
 
     createBuffer(bufferSize, 
         vk::BufferUsageFlagBits::eTransferDst |
         vk::BufferUsageFlagBits::eIndexBuffer,
-        vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryUsage::eGpuOnly,
         m_IndexBuffer, m_IndexBufferMemory);
-    
-    copyBuffer(stagingBuffer, m_IndexBuffer, bufferSize);
 
-    m_Device.destroyBuffer(stagingBuffer);
-    m_Device.freeMemory(stagingBufferMemory);
+    m_UploadManager.uploadBuffer(m_IndexBuffer, m_Mesh.pIndices, bufferSize, 0,
+        vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eIndexRead);
 }
 
 void HelloTriangleApplication::createUniformBuffers()
 {
-    vk::DeviceSize bufferSize = sizeof(UniformBufferObject);
+    // a single persistently mapped ring, one region per frame in flight
+    vk::DeviceSize alignment = m_PhysicalDevice.getProperties().limits.minUniformBufferOffsetAlignment;
+    vk::DeviceSize frameSize = UniformRing::alignSize(UNIFORM_RING_FRAME_SIZE, alignment);
+    vk::DeviceSize bufferSize = frameSize * MAX_FRAMES_IN_FLIGHT;
+
+    createBuffer(bufferSize, 
+        vk::BufferUsageFlagBits::eUniformBuffer,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        MemoryUsage::eDynamic,
+        m_UniformBuffer,
+        m_UniformBufferMemory);
+
+    m_UniformRing.init(m_UniformBuffer, m_UniformBufferMemory.pMapped, frameSize, MAX_FRAMES_IN_FLIGHT, alignment);
+}
+
+void HelloTriangleApplication::createInstanceBuffer()
+{
+    // one region per frame in flight, like the uniform ring, so updates never touch what the GPU reads
+    uint32_t capacity = std::max(MIN_INSTANCE_CAPACITY, m_StressInstanceCount);
+    vk::DeviceSize alignment = m_PhysicalDevice.getProperties().limits.minStorageBufferOffsetAlignment;
+    vk::DeviceSize frameSize = UniformRing::alignSize(capacity * sizeof(InstanceData), alignment);
 
-    m_vecUniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    m_vecUniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    createBuffer(frameSize * MAX_FRAMES_IN_FLIGHT,
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        MemoryUsage::eDynamic,
+        m_InstanceBuffer,
+        m_InstanceBufferMemory);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-        createBuffer(bufferSize, 
-            vk::BufferUsageFlagBits::eUniformBuffer,
-            vk::MemoryPropertyFlagBits::eHostVisible |
-            vk::MemoryPropertyFlagBits::eHostCoherent,
-            m_vecUniformBuffers[i],
-            m_vecUniformBuffersMemory[i]);
+    m_Instances.init(m_InstanceBuffer, m_InstanceBufferMemory.pMapped, capacity, MAX_FRAMES_IN_FLIGHT, alignment);
+    // its bounds are refreshed every frame from the instance bounds
+    m_ModelObject = m_SceneObjects.add(glm::vec3(0.0f), glm::vec3(0.0f));
+
+    if (m_StressInstanceCount == 0) {
+        addInstance(glm::mat4(1.0f));
+        return;
+    }
+
+    // square grid on the ground plane around the original model
+    const MeshBounds& bounds = m_Mesh.bounds;
+    float spacing = 1.25f * std::max(bounds.max[0] - bounds.min[0], bounds.max[1] - bounds.min[1]);
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(m_StressInstanceCount))));
+    float origin = -0.5f * spacing * (side - 1);
+    for (uint32_t i = 0; i < m_StressInstanceCount; ++i) {
+        glm::vec3 offset(origin + spacing * (i % side), origin + spacing * (i / side), 0.0f);
+        addInstance(glm::translate(glm::mat4(1.0f), offset));
+    }
+}
+
+void HelloTriangleApplication::growInstanceBounds(const glm::mat4& model)
+{
+    const MeshBounds& bounds = m_Mesh.bounds;
+    glm::vec3 boundsMin, boundsMax;
+    transformBounds(model, glm::vec3(bounds.min[0], bounds.min[1], bounds.min[2]),
+        glm::vec3(bounds.max[0], bounds.max[1], bounds.max[2]), boundsMin, boundsMax);
+
+    if (m_InstanceBoundsEmpty) {
+        m_InstanceBoundsMin = boundsMin;
+        m_InstanceBoundsMax = boundsMax;
+        m_InstanceBoundsEmpty = false;
+        return;
+    }
+    m_InstanceBoundsMin = glm::min(m_InstanceBoundsMin, boundsMin);
+    m_InstanceBoundsMax = glm::max(m_InstanceBoundsMax, boundsMax);
+}
+
+void HelloTriangleApplication::createGpuCuller()
+{
+    m_GpuCuller.init(m_PhysicalDevice, m_Device, &m_Allocator, m_PipelineCache.get(), readFile("./src/shaders/cull.spv"), m_Mesh,
+        m_UniformRing.getBuffer(), m_Instances.getBuffer(), m_Instances.getFrameSize(),
+        m_Instances.getCapacity(), MAX_FRAMES_IN_FLIGHT);
 }
 
 void HelloTriangleApplication::createDescriptorPool()
 {
-    std::array<vk::DescriptorPoolSize, 2> poolSizes{};
-    poolSizes[0].setType(vk::DescriptorType::eUniformBuffer)
+    std::array<vk::DescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].setType(vk::DescriptorType::eUniformBufferDynamic)
         .setDescriptorCount(MAX_FRAMES_IN_FLIGHT);
     poolSizes[1].setType(vk::DescriptorType::eCombinedImageSampler)
         .setDescriptorCount(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[2].setType(vk::DescriptorType::eStorageBufferDynamic)
+        .setDescriptorCount(2 * MAX_FRAMES_IN_FLIGHT);
 
     vk::DescriptorPoolCreateInfo poolInfo{};
     poolInfo.setPoolSizes(poolSizes)
@@ -853,7 +1305,7 @@ void HelloTriangleApplication::createDescriptorSets()
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
     {
         vk::DescriptorBufferInfo bufferInfo{};
-        bufferInfo.setBuffer(m_vecUniformBuffers[i])
+        bufferInfo.setBuffer(m_UniformRing.getBuffer())
             .setOffset(0)
             .setRange(sizeof(UniformBufferObject));
 
@@ -862,11 +1314,21 @@ void HelloTriangleApplication::createDescriptorSets()
             .setImageView(m_TextureImageView)
             .setSampler(m_TextureSampler);
 
-        std::array<vk::WriteDescriptorSet, 2> descriptorWrites{};
+        vk::DescriptorBufferInfo instanceInfo{};
+        instanceInfo.setBuffer(m_Instances.getBuffer())
+            .setOffset(0)
+            .setRange(m_Instances.getFrameSize());
+
+        vk::DescriptorBufferInfo visibleInfo{};
+        visibleInfo.setBuffer(m_GpuCuller.getVisibleBuffer())
+            .setOffset(0)
+            .setRange(m_GpuCuller.getVisibleFrameSize());
+
+        std::array<vk::WriteDescriptorSet, 4> descriptorWrites{};
         descriptorWrites[0].setDstSet(m_vecDescriptorSets[i])
             .setDstBinding(0)
             .setDstArrayElement(0)
-            .setDescriptorType(vk::DescriptorType::eUniformBuffer)
+            .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
             .setDescriptorCount(1)
             .setBufferInfo(bufferInfo);
         
@@ -877,6 +1339,20 @@ void HelloTriangleApplication::createDescriptorSets()
             .setDescriptorCount(1)
             .setImageInfo(imageInfo);
 
+        descriptorWrites[2].setDstSet(m_vecDescriptorSets[i])
+            .setDstBinding(2)
+            .setDstArrayElement(0)
+            .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+            .setDescriptorCount(1)
+            .setBufferInfo(instanceInfo);
+
+        descriptorWrites[3].setDstSet(m_vecDescriptorSets[i])
+            .setDstBinding(3)
+            .setDstArrayElement(0)
+            .setDescriptorType(vk::DescriptorType::eStorageBufferDynamic)
+            .setDescriptorCount(1)
+            .setBufferInfo(visibleInfo);
+
         m_Device.updateDescriptorSets(descriptorWrites, nullptr);
     }
 }
@@ -888,6 +1364,15 @@ void HelloTriangleApplication::createCommandBuffers()
         .setLevel(vk::CommandBufferLevel::ePrimary)
         .setCommandBufferCount(MAX_FRAMES_IN_FLIGHT);
     m_vecCommandBuffers = m_Device.allocateCommandBuffers(allocInfo);
+
+    m_vecSecondaryCommandBuffers.resize(m_vecSecondaryCommandPools.size());
+    for (size_t i = 0; i < m_vecSecondaryCommandPools.size(); ++i) {
+        vk::CommandBufferAllocateInfo secondaryInfo{};
+        secondaryInfo.setCommandPool(m_vecSecondaryCommandPools[i])
+            .setLevel(vk::CommandBufferLevel::eSecondary)
+            .setCommandBufferCount(1);
+        m_vecSecondaryCommandBuffers[i] = m_Device.allocateCommandBuffers(secondaryInfo).front();
+    }
 }
 
 void HelloTriangleApplication::createSyncObjects()
@@ -907,6 +1392,15 @@ void HelloTriangleApplication::createSyncObjects()
     }
 }
 
+void HelloTriangleApplication::createQueryPools()
+{
+    QueueFamilyIndices indices = findQueueFamilies(m_PhysicalDevice);
+    m_GpuProfiler.init(m_PhysicalDevice, m_Device, indices.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT);
+
+    m_MainPassScope = m_GpuProfiler.registerScope("main pass");
+    m_CullPassScope = m_GpuProfiler.registerScope("culling");
+}
+
 void HelloTriangleApplication::recreateSwapChain()
 {
     int width = 0;
@@ -918,37 +1412,63 @@ void HelloTriangleApplication::recreateSwapChain()
     }
 
     m_Device.waitIdle();
+    FrameTimer::Scope scope(m_FrameTimer, FrameTimer::eRecreateSwapChain);
 
-    cleanupSwapChain();
-
+    // only what depends on the extent is rebuilt, createSwapChain retires the old swapchain itself
+    vk::Format oldFormat = m_SwapChainImageFormat;
+    cleanupSwapChainTargets();
     createSwapChain();
     createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
+
+    // the render pass and pipeline only go stale if the surface format changed
+    if (m_SwapChainImageFormat != oldFormat) {
+        m_Device.destroyPipeline(m_GraphicsPipeline);
+        m_Device.destroyPipelineLayout(m_PipelineLayout);
+        m_Device.destroyRenderPass(m_RenderPass);
+        createRenderPass();
+        createGraphicsPipeline();
+    }
+
     createColorResources();
     createDepthResources();
     createFramebuffers();
+    m_UploadManager.flush();
 }
 
-void HelloTriangleApplication::cleanupSwapChain()
+void HelloTriangleApplication::cleanupSwapChainTargets()
 {
     m_Device.destroyImageView(m_ColorImageView);
     m_Device.destroyImage(m_ColorImage);
-    m_Device.freeMemory(m_ColorImageMemory);
+    m_Allocator.free(m_ColorImageMemory);
 
     m_Device.destroyImageView(m_DepthImageView);
     m_Device.destroyImage(m_DepthImage);
-    m_Device.freeMemory(m_DepthImageMemory);
+    m_Allocator.free(m_DepthImageMemory);
 
     for (auto& framebuffer : m_vecSwapchainFramebuffers)
         m_Device.destroyFramebuffer(framebuffer);
+    m_vecSwapchainFramebuffers.clear();
+
+    for (auto& imageView : m_vecSwapChainImageViews)
+        m_Device.destroyImageView(imageView);
+    m_vecSwapChainImageViews.clear();
+}
+
+void HelloTriangleApplication::cleanupSwapChain()
+{
+    cleanupSwapChainTargets();
 
     m_Device.destroyPipeline(m_GraphicsPipeline);
     m_Device.destroyPipelineLayout(m_PipelineLayout);
     m_Device.destroyRenderPass(m_RenderPass);
 
-    for (auto& imageView : m_vecSwapChainImageViews)
-        m_Device.destroyImageView(imageView);
+    if (m_Headless) {
+        for (size_t i = 0; i < m_vecSwapChainImages.size(); ++i) {
+            m_Device.destroyImage(m_vecSwapChainImages[i]);
+            m_Allocator.free(m_vecOffscreenImagesMemory[i]);
+        }
+        return;
+    }
 
     m_Device.destroySwapchainKHR(m_SwapChain);
 }
@@ -958,8 +1478,8 @@ bool HelloTriangleApplication::isDeviceSuitable(vk::PhysicalDevice device) {
     
     bool extensionsSupported = checkDeviceExtensionSupport(device);
     
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    bool swapChainAdequate = m_Headless;
+    if (extensionsSupported && !m_Headless) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
@@ -972,7 +1492,8 @@ bool HelloTriangleApplication::isDeviceSuitable(vk::PhysicalDevice device) {
 bool HelloTriangleApplication::checkDeviceExtensionSupport(vk::PhysicalDevice device)
 {
     auto deviceExtensions = device.enumerateDeviceExtensionProperties();
-    std::set<std::string> requiredExtensions(m_vecDeviceExtensions.begin(), m_vecDeviceExtensions.end());
+    auto requiredDeviceExtensions = getRequiredDeviceExtensions();
+    std::set<std::string> requiredExtensions(requiredDeviceExtensions.begin(), requiredDeviceExtensions.end());
 
     for (const auto& extension : deviceExtensions)
         requiredExtensions.erase(extension.extensionName);
@@ -1006,16 +1527,27 @@ HelloTriangleApplication::findQueueFamilies(vk::PhysicalDevice device)
     int i = 0;
     for (const auto& queueFamily : queueFamilyProperties)
     {
-        if (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)
+        if (!indices.graphicsFamily && (queueFamily.queueFlags & vk::QueueFlagBits::eGraphics))
             indices.graphicsFamily = i;
 
-        auto presentSupport = device.getSurfaceSupportKHR(i, m_Surface);
-        if (presentSupport) indices.presentFamily = i;
-        
-        if (indices.isComplete())   break;
+        // nothing is presented in headless mode, the graphics queue stands in
+        if (m_Headless) indices.presentFamily = indices.graphicsFamily;
+        else if (!indices.presentFamily && device.getSurfaceSupportKHR(i, m_Surface)) indices.presentFamily = i;
+
+        // a family with transfer but no graphics is the DMA engine; prefer one without compute too
+        bool transferOnly = (queueFamily.queueFlags & vk::QueueFlagBits::eTransfer) &&
+            !(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics);
+        bool noCompute = !(queueFamily.queueFlags & vk::QueueFlagBits::eCompute);
+        if (transferOnly && (!indices.transferFamily ||
+            (noCompute && (queueFamilyProperties[*indices.transferFamily].queueFlags & vk::QueueFlagBits::eCompute))))
+            indices.transferFamily = i;
+
         ++i;
     }
 
+    if (indices.transferFamily)
+        indices.transferImageGranularity = queueFamilyProperties[*indices.transferFamily].minImageTransferGranularity;
+
     return indices;
 }
 
@@ -1091,6 +1623,18 @@ void HelloTriangleApplication::recordCommandBuffer(vk::CommandBuffer commandBuff
 
     commandBuffer.begin(beginInfo);
 
+    m_GpuProfiler.beginFrame(commandBuffer, m_CurrentFrame);
+
+    // the model is the only scene object so far, m_GpuCuller then culls its instances
+    bool modelVisible = std::find(m_vecVisibleObjects.begin(), m_vecVisibleObjects.end(), m_ModelObject) != m_vecVisibleObjects.end();
+
+    m_GpuProfiler.beginScope(commandBuffer, m_CurrentFrame, m_CullPassScope);
+    if (modelVisible)
+        m_GpuCuller.record(commandBuffer, m_CurrentFrame, m_CullUniformOffset, m_InstanceDynamicOffset, m_Instances.getCount());
+    m_GpuProfiler.endScope(commandBuffer, m_CurrentFrame, m_CullPassScope);
+
+    m_GpuProfiler.beginScope(commandBuffer, m_CurrentFrame, m_MainPassScope);
+
     vk::RenderPassBeginInfo renderPassInfo{};
     renderPassInfo.setRenderPass(m_RenderPass)
         .setFramebuffer(m_vecSwapchainFramebuffers[imageIndex])
@@ -1102,35 +1646,79 @@ void HelloTriangleApplication::recordCommandBuffer(vk::CommandBuffer commandBuff
     clearValues[1].setDepthStencil({ 1.0f, 0 });
     renderPassInfo.setClearValues(clearValues);
 
-    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-    commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_GraphicsPipeline);
-
-    vk::Buffer vertexBuffers[] = { m_VertexBuffer };
-    vk::DeviceSize offsets[] = { 0 };
-    commandBuffer.bindVertexBuffers(0, 1, vertexBuffers, offsets);
-    commandBuffer.bindIndexBuffer(m_IndexBuffer, 0, vk::IndexType::eUint32);
-    
-    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, m_vecDescriptorSets[imageIndex], nullptr);
-    commandBuffer.drawIndexed(m_Indices.size(), 1, 0, 0, 0);
+    // the draws live in secondaries recorded in parallel, the pass only stitches them together
+    uint32_t jobCount = recordDrawCommands(imageIndex, modelVisible);
 
+    commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+    if (jobCount > 0)
+        commandBuffer.executeCommands(jobCount, &m_vecSecondaryCommandBuffers[m_CurrentFrame * m_RecordThreadCount]);
     commandBuffer.endRenderPass();
+
+    m_GpuProfiler.endScope(commandBuffer, m_CurrentFrame, m_MainPassScope);
+
     commandBuffer.end();
 }
 
-uint32_t HelloTriangleApplication::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags propertyFlags)
+uint32_t HelloTriangleApplication::recordDrawCommands(uint32_t imageIndex, bool modelVisible)
 {
-    vk::PhysicalDeviceMemoryProperties memProperties = m_PhysicalDevice.getMemoryProperties();
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i)
-        if (typeFilter & (1 << i) &&
-            (memProperties.memoryTypes[i].propertyFlags & propertyFlags)) 
-            { return i; }
+    // the frame's fence has signalled, nothing recorded into its pools is still pending
+    uint32_t& recordedJobCount = m_vecRecordedJobCounts[m_CurrentFrame];
+    for (uint32_t thread = 0; thread < recordedJobCount; ++thread)
+        m_Device.resetCommandPool(m_vecSecondaryCommandPools[m_CurrentFrame * m_RecordThreadCount + thread]);
+    recordedJobCount = 0;
+    if (!modelVisible || m_GpuCuller.getCommandCount() == 0) return 0;
+
+    // every job takes a run of whole LODs, so a multi-draw stays one call per job
+    uint32_t lodCount = m_GpuCuller.getLodCount();
+    uint32_t jobCount = std::min(m_RecordThreadCount, lodCount);
+
+    parallelFor(jobCount, jobCount, [&](size_t job) {
+        vk::CommandBuffer commandBuffer = m_vecSecondaryCommandBuffers[m_CurrentFrame * m_RecordThreadCount + job];
+
+        vk::CommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.setRenderPass(m_RenderPass)
+            .setSubpass(0)
+            .setFramebuffer(m_vecSwapchainFramebuffers[imageIndex]);
+        vk::CommandBufferBeginInfo beginInfo{};
+        beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
+            .setPInheritanceInfo(&inheritanceInfo);
+        commandBuffer.begin(beginInfo);
+
+        // secondaries inherit no state from the primary
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_GraphicsPipeline);
+        vk::Viewport viewport(0.0f, 0.0f, static_cast<float>(m_SwapChainExtent.width),
+            static_cast<float>(m_SwapChainExtent.height), 0.0f, 1.0f);
+        commandBuffer.setViewport(0, viewport);
+        commandBuffer.setScissor(0, vk::Rect2D({ 0, 0 }, m_SwapChainExtent));
+        vk::DeviceSize offset = 0;
+        commandBuffer.bindVertexBuffers(0, m_VertexBuffer, offset);
+        commandBuffer.bindIndexBuffer(m_IndexBuffer, 0, m_Mesh.indexSize == sizeof(uint16_t) ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+
+        // dynamic offsets go in binding order: uniforms, instances, visible instances
+        std::array<uint32_t, 3> dynamicOffsets = { m_UniformDynamicOffset, m_InstanceDynamicOffset,
+            static_cast<uint32_t>(m_GpuCuller.getVisibleFrameSize() * m_CurrentFrame) };
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, m_vecDescriptorSets[m_CurrentFrame], dynamicOffsets);
+
+        uint32_t firstDraw = m_GpuCuller.getLodFirstCommand(static_cast<uint32_t>(uint64_t(lodCount) * job / jobCount));
+        uint32_t lastDraw = m_GpuCuller.getLodFirstCommand(static_cast<uint32_t>(uint64_t(lodCount) * (job + 1) / jobCount));
+        m_GpuCuller.draw(commandBuffer, m_CurrentFrame, m_PipelineLayout, firstDraw, lastDraw - firstDraw);
+
+        commandBuffer.end();
+    });
+    recordedJobCount = jobCount;
+    return jobCount;
+}
 
-    throw std::runtime_error("failed to find suitable memory type!");
+uint32_t HelloTriangleApplication::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags propertyFlags, MemoryUsage memoryUsage)
+{
+    // every flag in propertyFlags is mandatory, memoryUsage ranks the remaining candidates
+    return m_Allocator.getMemoryTypeSelector().select(typeFilter, propertyFlags, memoryUsage);
 }
 
 
 void HelloTriangleApplication::createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage,
-                vk::MemoryPropertyFlags properties, vk::Buffer& buffer, vk::DeviceMemory& bufferMemory)
+                vk::MemoryPropertyFlags properties, MemoryUsage memoryUsage,
+                vk::Buffer& buffer, MemoryAllocation& bufferMemory)
 {
     vk::BufferCreateInfo bufferInfo{};
     bufferInfo.setSize(size)
@@ -1142,28 +1730,11 @@ void HelloTriangleApplication::createBuffer(vk::DeviceSize size, vk::BufferUsage
 
     vk::MemoryRequirements memRequirements = m_Device.getBufferMemoryRequirements(buffer);
 
-    vk::MemoryAllocateInfo allocInfo{};
-    allocInfo.setAllocationSize(memRequirements.size)
-        .setMemoryTypeIndex(findMemoryType(memRequirements.memoryTypeBits, properties));
-
-    bufferMemory = m_Device.allocateMemory(allocInfo);
+    bufferMemory = m_Allocator.allocate(memRequirements,
+        findMemoryType(memRequirements.memoryTypeBits, properties, memoryUsage), ResourceKind::eLinear);
     if (!bufferMemory)  throw std::runtime_error("failed to allocate buffer memory!");
 
-    m_Device.bindBufferMemory(buffer, bufferMemory, 0);
-}
-
-void HelloTriangleApplication::copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size)
-{
-    vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
-
-    vk::BufferCopy copyRegin{};
-    copyRegin.setSrcOffset(0)
-        .setDstOffset(0)
-        .setSize(size);
-
-    commandBuffer.copyBuffer(srcBuffer, dstBuffer, copyRegin);
-
-    endSingleTimeCommands(commandBuffer);
+    m_Device.bindBufferMemory(buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
 void HelloTriangleApplication::updateUniformBuffer(uint32_t currentImage)
@@ -1180,16 +1751,30 @@ void HelloTriangleApplication::updateUniformBuffer(uint32_t currentImage)
          0.01f, 10.0f);
     ubo.proj[1][1] *= -1;
 
-    void* data;
-    const auto&_ = m_Device.mapMemory(m_vecUniformBuffersMemory[currentImage], 0, sizeof(ubo), vk::MemoryMapFlags{0}, &data);
-    memcpy(data, &ubo, sizeof(UniformBufferObject));
-    m_Device.unmapMemory(m_vecUniformBuffersMemory[currentImage]);
+    const MeshDequantize& dequantize = m_Mesh.dequantize;
+    ubo.positionScale = glm::vec4(dequantize.positionScale[0], dequantize.positionScale[1], dequantize.positionScale[2], 0.0f);
+    ubo.positionOffset = glm::vec4(dequantize.positionOffset[0], dequantize.positionOffset[1], dequantize.positionOffset[2], 0.0f);
+    ubo.texCoordTransform = glm::vec4(dequantize.texCoordScale[0], dequantize.texCoordScale[1],
+        dequantize.texCoordOffset[0], dequantize.texCoordOffset[1]);
+
+    m_UniformRing.beginFrame(currentImage);
+    m_UniformDynamicOffset = m_UniformRing.push(&ubo, sizeof(UniformBufferObject));
+    m_InstanceDynamicOffset = m_Instances.beginFrame(currentImage);
+
+    GpuCuller::Uniforms cullUniforms = m_GpuCuller.buildUniforms(ubo.model, ubo.view, ubo.proj,
+        static_cast<float>(m_SwapChainExtent.height), LOD_PIXEL_ERROR, m_Instances.getCount());
+    m_CullUniformOffset = m_UniformRing.push(&cullUniforms, sizeof(GpuCuller::Uniforms));
+
+    glm::vec3 worldMin, worldMax;
+    transformBounds(ubo.model, m_InstanceBoundsMin, m_InstanceBoundsMax, worldMin, worldMax);
+    m_SceneObjects.update(m_ModelObject, worldMin, worldMax);
+    m_SceneObjects.cull(Frustum::fromMatrix(ubo.proj * ubo.view), m_vecVisibleObjects, defaultThreadCount());
 }
 
 void HelloTriangleApplication::createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
         vk::SampleCountFlagBits numSamples, vk::Format format, vk::ImageTiling tiling,
-        vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, 
-        vk::Image& image, vk::DeviceMemory& memory)
+        vk::ImageUsageFlags usage, vk::MemoryPropertyFlags properties, MemoryUsage memoryUsage,
+        vk::Image& image, MemoryAllocation& memory)
 {
     vk::ImageCreateInfo imageInfo{};
     imageInfo.setImageType(vk::ImageType::e2D)
@@ -1208,14 +1793,12 @@ void HelloTriangleApplication::createImage(uint32_t width, uint32_t height, uint
 
     vk::MemoryRequirements memRequirements = m_Device.getImageMemoryRequirements(image);
 
-    vk::MemoryAllocateInfo allocInfo{};
-    allocInfo.setAllocationSize(memRequirements.size)
-        .setMemoryTypeIndex(findMemoryType(memRequirements.memoryTypeBits, properties));
-
-    memory = m_Device.allocateMemory(allocInfo);
+    memory = m_Allocator.allocate(memRequirements,
+        findMemoryType(memRequirements.memoryTypeBits, properties, memoryUsage),
+        tiling == vk::ImageTiling::eOptimal ? ResourceKind::eOptimal : ResourceKind::eLinear);
     if (!memory) throw std::runtime_error("failed to allocate image memory!");
 
-    m_Device.bindImageMemory(image, memory, 0);
+    m_Device.bindImageMemory(image, memory.memory, memory.offset);
 }
 
 vk::CommandBuffer HelloTriangleApplication::beginSingleTimeCommands()
@@ -1248,11 +1831,9 @@ void HelloTriangleApplication::endSingleTimeCommands(vk::CommandBuffer commandBu
     m_Device.freeCommandBuffers(m_CommandPool, commandBuffer);
 }
 
-void HelloTriangleApplication::transitionImageLayout(vk::Image image, vk::Format format,
+void HelloTriangleApplication::transitionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, vk::Format format,
     vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t mipLevels)
 {
-    vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
-
     vk::ImageMemoryBarrier barrier{};
     barrier.setOldLayout(oldLayout)
         .setNewLayout(newLayout)
@@ -1308,27 +1889,6 @@ void HelloTriangleApplication::transitionImageLayout(vk::Image image, vk::Format
         sourceStage, destinationStage,
         vk::DependencyFlags{0},
         nullptr, nullptr, barrier);
-    
-    endSingleTimeCommands(commandBuffer);
-}
-
-void HelloTriangleApplication::copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height)
-{
-    vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
-
-    vk::BufferImageCopy region{};
-    region.setBufferOffset(0)
-        .setBufferRowLength(0)
-        .setBufferImageHeight(0)
-        .setImageSubresource(vk::ImageSubresourceLayers(
-            vk::ImageAspectFlagBits::eColor,
-            0, 0, 1))
-        .setImageOffset(vk::Offset3D(0, 0, 0))
-        .setImageExtent(vk::Extent3D(width, height, 1));
-    
-    commandBuffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
-
-    endSingleTimeCommands(commandBuffer);
 }
 
 vk::ImageView HelloTriangleApplication::createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels)
@@ -1377,88 +1937,6 @@ bool HelloTriangleApplication::hasStencilComponent(vk::Format format)
             format == vk::Format::eD24UnormS8Uint;
 }
 
-void HelloTriangleApplication::generateMipmaps(vk::Image image, vk::Format format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
-{
-    vk::FormatProperties formatProperties = m_PhysicalDevice.getFormatProperties(format);
-    if (!(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear))
-        throw std::runtime_error("texture image format does not support linear blitting!");
-    
-    vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
-    
-    vk::ImageMemoryBarrier barrier{};
-    barrier.setImage(image)
-        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
-        .setSubresourceRange(vk::ImageSubresourceRange(
-            vk::ImageAspectFlagBits::eColor,
-            0,
-            1,
-            0,
-            1));
-    
-    int32_t mipWidth = texWidth;
-    int32_t mipHeight = texHeight;
-
-    for (uint32_t i = 1; i < mipLevels; ++i)
-    {
-        barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
-            .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
-            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-            .setDstAccessMask(vk::AccessFlagBits::eTransferRead)
-            .subresourceRange.setBaseMipLevel(i - 1);
-
-        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-            vk::PipelineStageFlagBits::eTransfer,
-            vk::DependencyFlags{0},
-            {}, {}, barrier);
-    
-        vk::ImageBlit blit{};
-        blit.setSrcOffsets({ { { 0, 0, 0 }, { mipWidth, mipHeight, 1 } } })
-            .setSrcSubresource(vk::ImageSubresourceLayers(
-                vk::ImageAspectFlagBits::eColor,
-                i - 1,
-                0,
-                1))
-            .setDstOffsets({ { { 0, 0, 0 }, {
-                mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 } } })
-            .setDstSubresource(vk::ImageSubresourceLayers(
-                vk::ImageAspectFlagBits::eColor,
-                i,
-                0,
-                1));
-
-        commandBuffer.blitImage(image, vk::ImageLayout::eTransferSrcOptimal,
-            image, vk::ImageLayout::eTransferDstOptimal,
-            blit, vk::Filter::eLinear);
-    
-        barrier.setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
-            .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-            .setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
-            .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
-
-        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-            vk::PipelineStageFlagBits::eFragmentShader,
-            vk::DependencyFlags{0},
-            {}, {}, barrier);
-    
-        if (mipWidth > 1) mipWidth /= 2;
-        if (mipHeight > 1) mipHeight /= 2;
-    }
-
-    barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
-        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
-        .setDstAccessMask(vk::AccessFlagBits::eShaderRead)
-        .subresourceRange.setBaseMipLevel(mipLevels - 1);
-
-    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
-        vk::PipelineStageFlagBits::eFragmentShader,
-        vk::DependencyFlags{0},
-        {}, {}, barrier);
-    
-    endSingleTimeCommands(commandBuffer);
-}
-
 vk::SampleCountFlagBits HelloTriangleApplication::getMaxUsableSampleCount()
 {
     vk::PhysicalDeviceProperties physicalDeviceProperties = m_PhysicalDevice.getProperties();
@@ -1511,26 +1989,47 @@ void HelloTriangleApplication::createInstance() {
 
 void HelloTriangleApplication::drawFrame()
 {
-    const auto& _ = m_Device.waitForFences(m_vecInFlightFences[m_CurrentFrame], true, std::numeric_limits<uint64_t>::max());
+    {
+        FrameTimer::Scope scope(m_FrameTimer, FrameTimer::eWaitForFences);
+        const auto& _ = m_Device.waitForFences(m_vecInFlightFences[m_CurrentFrame], true, std::numeric_limits<uint64_t>::max());
+    }
+    m_GpuProfiler.collect(m_CurrentFrame);
+    m_UploadManager.poll();
 
-    const auto& value = m_Device.acquireNextImageKHR(m_SwapChain, std::numeric_limits<uint64_t>::max(), m_vecImageAvailableSemaphores[m_CurrentFrame], nullptr);
-    if (value.result == vk::Result::eErrorOutOfDateKHR)
+    uint32_t imageIndex = 0;
+    vk::Result acquireResult = vk::Result::eSuccess;
+    {
+        FrameTimer::Scope scope(m_FrameTimer, FrameTimer::eAcquireNextImage);
+        try
+        {
+            const auto& value = m_Device.acquireNextImageKHR(m_SwapChain, std::numeric_limits<uint64_t>::max(), m_vecImageAvailableSemaphores[m_CurrentFrame], nullptr);
+            acquireResult = value.result;
+            imageIndex = value.value;
+        }
+        catch (vk::OutOfDateKHRError const&)
+        {
+            acquireResult = vk::Result::eErrorOutOfDateKHR;
+        }
+    }
+    if (acquireResult == vk::Result::eErrorOutOfDateKHR)
     {
         recreateSwapChain();
         return;
     }
-    else if (value.result != vk::Result::eSuccess && value.result != vk::Result::eSuboptimalKHR)
+    else if (acquireResult != vk::Result::eSuccess && acquireResult != vk::Result::eSuboptimalKHR)
         throw std::runtime_error("failed to acquire swap chain image!");
     
     // only reset the fence if we are submitting work
-    uint32_t imageIndex = value.value;
 
     updateUniformBuffer(m_CurrentFrame);
 
     m_Device.resetFences(m_vecInFlightFences[m_CurrentFrame]);
 
-    m_vecCommandBuffers[m_CurrentFrame].reset(vk::CommandBufferResetFlags{0});
-    recordCommandBuffer(m_vecCommandBuffers[m_CurrentFrame], imageIndex);
+    {
+        FrameTimer::Scope scope(m_FrameTimer, FrameTimer::eRecordCommands);
+        m_vecCommandBuffers[m_CurrentFrame].reset(vk::CommandBufferResetFlags{0});
+        recordCommandBuffer(m_vecCommandBuffers[m_CurrentFrame], imageIndex);
+    }
 
     vk::SubmitInfo submitInfo{};
     vk::Semaphore waitSemaphores[] = { m_vecImageAvailableSemaphores[m_CurrentFrame] };
@@ -1555,13 +2054,15 @@ void HelloTriangleApplication::drawFrame()
     vk::Result result = vk::Result::eSuccess;
     try
     {
+        FrameTimer::Scope scope(m_FrameTimer, FrameTimer::ePresent);
         result = m_PresentQueue.presentKHR(presentInfo);
     }
     catch (vk::OutOfDateKHRError const&)
     {
         result = vk::Result::eErrorOutOfDateKHR;
     }
-    if (result == vk::Result::eSuboptimalKHR || result == vk::Result::eErrorOutOfDateKHR)
+    // not every platform reports a resize through present, the callback flag covers the rest
+    if (result == vk::Result::eSuboptimalKHR || result == vk::Result::eErrorOutOfDateKHR || m_FramebufferResized)
     {
         m_FramebufferResized = false;
         recreateSwapChain();
@@ -1570,4 +2071,112 @@ void HelloTriangleApplication::drawFrame()
         throw std::runtime_error("presentKHR failed!");
 
     m_CurrentFrame = (m_CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-}
\ No newline at end of file
+}
+
+void HelloTriangleApplication::drawOffscreenFrame()
+{
+    {
+        FrameTimer::Scope scope(m_FrameTimer, FrameTimer::eWaitForFences);
+        const auto& _ = m_Device.waitForFences(m_vecInFlightFences[m_CurrentFrame], true, std::numeric_limits<uint64_t>::max());
+    }
+    m_GpuProfiler.collect(m_CurrentFrame);
+    m_UploadManager.poll();
+
+    // offscreen images are indexed by frame, there is nothing to acquire
+    uint32_t imageIndex = m_CurrentFrame;
+
+    updateUniformBuffer(m_CurrentFrame);
+
+    m_Device.resetFences(m_vecInFlightFences[m_CurrentFrame]);
+
+    {
+        FrameTimer::Scope scope(m_FrameTimer, FrameTimer::eRecordCommands);
+        m_vecCommandBuffers[m_CurrentFrame].reset(vk::CommandBufferResetFlags{0});
+        recordCommandBuffer(m_vecCommandBuffers[m_CurrentFrame], imageIndex);
+    }
+
+    vk::SubmitInfo submitInfo{};
+    submitInfo.setCommandBuffers(m_vecCommandBuffers[m_CurrentFrame]);
+
+    m_GraphicsQueue.submit(submitInfo, m_vecInFlightFences[m_CurrentFrame]);
+
+    m_LastRenderedImage = imageIndex;
+    m_CurrentFrame = (m_CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+void HelloTriangleApplication::saveOffscreenImage(const std::string& path)
+{
+    m_Device.waitIdle();
+
+    uint32_t width = m_SwapChainExtent.width;
+    uint32_t height = m_SwapChainExtent.height;
+    vk::DeviceSize imageSize = static_cast<vk::DeviceSize>(width) * height * 4;
+
+    vk::Buffer readbackBuffer;
+    MemoryAllocation readbackBufferMemory;
+    createBuffer(imageSize, vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+        vk::MemoryPropertyFlagBits::eHostCoherent,
+        MemoryUsage::eReadback, readbackBuffer, readbackBufferMemory);
+
+    vk::CommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    // the render pass leaves the resolve target in eTransferSrcOptimal,
+    // only the color writes still have to be made visible to the copy
+    vk::ImageMemoryBarrier barrier{};
+    barrier.setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+        .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setImage(m_vecSwapChainImages[m_LastRenderedImage])
+        .setSubresourceRange(vk::ImageSubresourceRange(
+            vk::ImageAspectFlagBits::eColor,
+            0, 1, 0, 1))
+        .setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput,
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags{0},
+        nullptr, nullptr, barrier);
+
+    vk::BufferImageCopy region{};
+    region.setBufferOffset(0)
+        .setBufferRowLength(0)
+        .setBufferImageHeight(0)
+        .setImageSubresource(vk::ImageSubresourceLayers(
+            vk::ImageAspectFlagBits::eColor,
+            0, 0, 1))
+        .setImageOffset(vk::Offset3D(0, 0, 0))
+        .setImageExtent(vk::Extent3D(width, height, 1));
+
+    commandBuffer.copyImageToBuffer(m_vecSwapChainImages[m_LastRenderedImage],
+        vk::ImageLayout::eTransferSrcOptimal, readbackBuffer, region);
+
+    endSingleTimeCommands(commandBuffer);
+
+    void* data = readbackBufferMemory.pMapped;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("failed to open readback file!");
+
+    // binary PPM, dropping alpha and swizzling BGRA targets back to RGB
+    file << "P6\n" << width << " " << height << "\n255\n";
+    bool swizzle = m_SwapChainImageFormat == vk::Format::eB8G8R8A8Srgb;
+    const auto* pixels = static_cast<const uint8_t*>(data);
+    std::vector<char> row(width * 3);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const uint8_t* texel = pixels + (static_cast<size_t>(y) * width + x) * 4;
+            row[x * 3 + 0] = static_cast<char>(texel[swizzle ? 2 : 0]);
+            row[x * 3 + 1] = static_cast<char>(texel[1]);
+            row[x * 3 + 2] = static_cast<char>(texel[swizzle ? 0 : 2]);
+        }
+        file.write(row.data(), row.size());
+    }
+    file.close();
+
+    m_Device.destroyBuffer(readbackBuffer);
+    m_Allocator.free(readbackBufferMemory);
+}
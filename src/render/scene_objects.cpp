@@ -0,0 +1,259 @@
+#include "render/scene_objects.h"
+#include "render/parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// AVX needs LEARNVK_AVX (-mavx or /arch:AVX), SSE2 is part of every x86-64 target
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SCENE_OBJECTS_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_OBJECTS_SSE
+#endif
+
+namespace {
+    // arrays are padded for the widest path so any of them can load whole lanes
+    constexpr uint32_t LANE_PADDING = 8;
+}
+
+SceneObjects::CullPlanes SceneObjects::buildCullPlanes(const Frustum& frustum)
+{
+    CullPlanes planes;
+    for (int p = 0; p < 6; ++p) {
+        for (int axis = 0; axis < 3; ++axis) {
+            planes.normal[p][axis] = frustum.planes[p][axis];
+            planes.absNormal[p][axis] = std::abs(frustum.planes[p][axis]);
+        }
+        planes.distance[p] = frustum.planes[p].w;
+    }
+    return planes;
+}
+
+SceneObjects::Handle SceneObjects::add(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    Handle handle;
+    if (!m_vecFreeHandles.empty()) {
+        handle = m_vecFreeHandles.back();
+        m_vecFreeHandles.pop_back();
+    } else {
+        handle = static_cast<Handle>(m_vecSlotOfHandle.size());
+        m_vecSlotOfHandle.push_back(0);
+    }
+
+    uint32_t slot = getCount();
+    size_t paddedCount = (slot + LANE_PADDING) / LANE_PADDING * LANE_PADDING;
+    if (m_vecCenterX.size() < paddedCount) {
+        for (std::vector<float>* pArray : { &m_vecCenterX, &m_vecCenterY, &m_vecCenterZ,
+                &m_vecExtentX, &m_vecExtentY, &m_vecExtentZ })
+            pArray->resize(paddedCount, 0.0f);
+    }
+
+    m_vecHandleOfSlot.push_back(handle);
+    m_vecSlotOfHandle[handle] = slot;
+    store(slot, boundsMin, boundsMax);
+    return handle;
+}
+
+void SceneObjects::remove(Handle handle)
+{
+    uint32_t slot = slotOf(handle);
+    uint32_t last = getCount() - 1;
+    if (slot != last) {
+        m_vecCenterX[slot] = m_vecCenterX[last];
+        m_vecCenterY[slot] = m_vecCenterY[last];
+        m_vecCenterZ[slot] = m_vecCenterZ[last];
+        m_vecExtentX[slot] = m_vecExtentX[last];
+        m_vecExtentY[slot] = m_vecExtentY[last];
+        m_vecExtentZ[slot] = m_vecExtentZ[last];
+        m_vecHandleOfSlot[slot] = m_vecHandleOfSlot[last];
+        m_vecSlotOfHandle[m_vecHandleOfSlot[slot]] = slot;
+    }
+    m_vecHandleOfSlot.pop_back();
+    m_vecSlotOfHandle[handle] = INVALID_SLOT;
+    m_vecFreeHandles.push_back(handle);
+}
+
+void SceneObjects::update(Handle handle, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    store(slotOf(handle), boundsMin, boundsMax);
+}
+
+void SceneObjects::clear()
+{
+    for (std::vector<float>* pArray : { &m_vecCenterX, &m_vecCenterY, &m_vecCenterZ,
+            &m_vecExtentX, &m_vecExtentY, &m_vecExtentZ })
+        pArray->clear();
+    m_vecSlotOfHandle.clear();
+    m_vecHandleOfSlot.clear();
+    m_vecFreeHandles.clear();
+}
+
+uint32_t SceneObjects::slotOf(Handle handle) const
+{
+    if (handle >= m_vecSlotOfHandle.size() || m_vecSlotOfHandle[handle] == INVALID_SLOT)
+        throw std::runtime_error("invalid scene object handle!");
+    return m_vecSlotOfHandle[handle];
+}
+
+void SceneObjects::cull(const Frustum& frustum, std::vector<Handle>& vecVisible, uint32_t threadCount)
+{
+    vecVisible.clear();
+    uint32_t count = getCount();
+    if (threadCount <= 1 || count < PARALLEL_CULL_THRESHOLD) {
+        cullRange(frustum, 0, count, vecVisible);
+        return;
+    }
+
+    // blocks keep their own lists so the result comes out in slot order
+    uint32_t blockCount = (count + CULL_BLOCK_SIZE - 1) / CULL_BLOCK_SIZE;
+    if (m_vecBlockVisible.size() < blockCount) m_vecBlockVisible.resize(blockCount);
+    parallelFor(blockCount, threadCount, [&](size_t block) {
+        uint32_t begin = static_cast<uint32_t>(block) * CULL_BLOCK_SIZE;
+        uint32_t end = std::min(begin + CULL_BLOCK_SIZE, count);
+        m_vecBlockVisible[block].clear();
+        cullRange(frustum, begin, end, m_vecBlockVisible[block]);
+    });
+    for (uint32_t block = 0; block < blockCount; ++block)
+        vecVisible.insert(vecVisible.end(), m_vecBlockVisible[block].begin(), m_vecBlockVisible[block].end());
+}
+
+void SceneObjects::cullScalar(const Frustum& frustum, std::vector<Handle>& vecVisible) const
+{
+    vecVisible.clear();
+    CullPlanes planes = buildCullPlanes(frustum);
+    for (uint32_t i = 0; i < getCount(); ++i)
+        if (touchesFrustum(planes, i)) vecVisible.push_back(m_vecHandleOfSlot[i]);
+}
+
+const char* SceneObjects::getSimdName()
+{
+#if defined(SCENE_OBJECTS_AVX)
+    return "AVX";
+#elif defined(SCENE_OBJECTS_SSE)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+void SceneObjects::store(uint32_t slot, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+    m_vecCenterX[slot] = center.x;
+    m_vecCenterY[slot] = center.y;
+    m_vecCenterZ[slot] = center.z;
+    m_vecExtentX[slot] = extent.x;
+    m_vecExtentY[slot] = extent.y;
+    m_vecExtentZ[slot] = extent.z;
+}
+
+bool SceneObjects::touchesFrustum(const CullPlanes& planes, uint32_t slot) const
+{
+    for (int p = 0; p < 6; ++p) {
+        // the box touches the inner side when its projected radius reaches the plane
+        float distance = planes.normal[p][0] * m_vecCenterX[slot] + planes.normal[p][1] * m_vecCenterY[slot]
+            + (planes.normal[p][2] * m_vecCenterZ[slot] + planes.distance[p]);
+        float radius = planes.absNormal[p][0] * m_vecExtentX[slot] + planes.absNormal[p][1] * m_vecExtentY[slot]
+            + planes.absNormal[p][2] * m_vecExtentZ[slot];
+        if (distance + radius < 0.0f) return false;
+    }
+    return true;
+}
+
+void SceneObjects::cullRange(const Frustum& frustum, uint32_t begin, uint32_t end, std::vector<Handle>& vecVisible) const
+{
+    // begin is a multiple of the lane count, lanes past end are masked off
+    CullPlanes planes = buildCullPlanes(frustum);
+
+#if defined(SCENE_OBJECTS_AVX)
+    const uint32_t LANES = 8;
+    __m256 normal[6][3], absNormal[6][3], distance[6];
+    for (int p = 0; p < 6; ++p) {
+        for (int axis = 0; axis < 3; ++axis) {
+            normal[p][axis] = _mm256_set1_ps(planes.normal[p][axis]);
+            absNormal[p][axis] = _mm256_set1_ps(planes.absNormal[p][axis]);
+        }
+        distance[p] = _mm256_set1_ps(planes.distance[p]);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (uint32_t i = begin; i < end; i += LANES) {
+        __m256 centerX = _mm256_loadu_ps(&m_vecCenterX[i]);
+        __m256 centerY = _mm256_loadu_ps(&m_vecCenterY[i]);
+        __m256 centerZ = _mm256_loadu_ps(&m_vecCenterZ[i]);
+        __m256 extentX = _mm256_loadu_ps(&m_vecExtentX[i]);
+        __m256 extentY = _mm256_loadu_ps(&m_vecExtentY[i]);
+        __m256 extentZ = _mm256_loadu_ps(&m_vecExtentZ[i]);
+
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(normal[p][0], centerX), _mm256_mul_ps(normal[p][1], centerY)),
+                _mm256_add_ps(_mm256_mul_ps(normal[p][2], centerZ), distance[p]));
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absNormal[p][0], extentX), _mm256_mul_ps(absNormal[p][1], extentY)),
+                _mm256_mul_ps(absNormal[p][2], extentZ));
+            visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+        }
+
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(visible));
+        if (end - i < LANES) mask &= (1u << (end - i)) - 1;
+        for (uint32_t lane = 0; mask != 0; ++lane, mask >>= 1)
+            if (mask & 1) vecVisible.push_back(m_vecHandleOfSlot[i + lane]);
+    }
+#elif defined(SCENE_OBJECTS_SSE)
+    const uint32_t LANES = 4;
+    __m128 normal[6][3], absNormal[6][3], distance[6];
+    for (int p = 0; p < 6; ++p) {
+        for (int axis = 0; axis < 3; ++axis) {
+            normal[p][axis] = _mm_set1_ps(planes.normal[p][axis]);
+            absNormal[p][axis] = _mm_set1_ps(planes.absNormal[p][axis]);
+        }
+        distance[p] = _mm_set1_ps(planes.distance[p]);
+    }
+    const __m128 zero = _mm_setzero_ps();
+
+    for (uint32_t i = begin; i < end; i += LANES) {
+        __m128 centerX = _mm_loadu_ps(&m_vecCenterX[i]);
+        __m128 centerY = _mm_loadu_ps(&m_vecCenterY[i]);
+        __m128 centerZ = _mm_loadu_ps(&m_vecCenterZ[i]);
+        __m128 extentX = _mm_loadu_ps(&m_vecExtentX[i]);
+        __m128 extentY = _mm_loadu_ps(&m_vecExtentY[i]);
+        __m128 extentZ = _mm_loadu_ps(&m_vecExtentZ[i]);
+
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[p][0], centerX), _mm_mul_ps(normal[p][1], centerY)),
+                _mm_add_ps(_mm_mul_ps(normal[p][2], centerZ), distance[p]));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absNormal[p][0], extentX), _mm_mul_ps(absNormal[p][1], extentY)),
+                _mm_mul_ps(absNormal[p][2], extentZ));
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+        }
+
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(visible));
+        if (end - i < LANES) mask &= (1u << (end - i)) - 1;
+        for (uint32_t lane = 0; mask != 0; ++lane, mask >>= 1)
+            if (mask & 1) vecVisible.push_back(m_vecHandleOfSlot[i + lane]);
+    }
+#else
+    for (uint32_t i = begin; i < end; ++i)
+        if (touchesFrustum(planes, i)) vecVisible.push_back(m_vecHandleOfSlot[i]);
+#endif
+}
+
+void transformBounds(const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+    glm::vec3& outMin, glm::vec3& outMax)
+{
+    // the new half extent along an axis sums the old ones scaled by that row's absolute weights
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+    glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+    glm::vec3 newExtent(0.0f);
+    for (int column = 0; column < 3; ++column)
+        for (int row = 0; row < 3; ++row)
+            newExtent[row] += std::abs(transform[column][row]) * extent[column];
+    outMin = newCenter - newExtent;
+    outMax = newCenter + newExtent;
+}
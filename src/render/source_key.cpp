@@ -0,0 +1,58 @@
+#include "render/source_key.h"
+#include "render/mapped_file.h"
+
+#include <cstring>
+#include <filesystem>
+
+namespace {
+    bool statFile(const std::string& path, SourceKey& key)
+    {
+        std::error_code error;
+        key.size = std::filesystem::file_size(path, error);
+        if (error) return false;
+        key.mtime = static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+        return !error;
+    }
+}
+
+bool SourceKey::compute(const std::string& path, SourceKey& key)
+{
+    if (!statFile(path, key)) return false;
+    key.contentHash = hashFile(path);
+    return true;
+}
+
+bool SourceKey::matches(const SourceKey& cached, const std::string& path)
+{
+    SourceKey current;
+    if (!statFile(path, current) || current.size != cached.size) return false;
+    return current.mtime == cached.mtime || hashFile(path) == cached.contentHash;
+}
+
+// 8 bytes per step, then a murmur3 finalizer
+uint64_t SourceKey::hashFile(const std::string& path)
+{
+    MappedFile file;
+    if (!file.open(path)) return 0;
+
+    const uint8_t* pData = file.getData();
+    size_t size = file.getSize();
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, pData + i, sizeof(word));
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, pData + i, size - i);
+    hash = (hash ^ tail) * 0xFF51AFD7ED558CCDull;
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
@@ -0,0 +1,227 @@
+#include "render/texture_cache.h"
+#include "render/source_key.h"
+#include "render/parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    constexpr uint32_t TEXTURE_CACHE_MAGIC = 0x544B564C; // "LVKT"
+    constexpr uint64_t LEVEL_ALIGNMENT = 16;
+    constexpr uint32_t MAX_LEVELS = 32;
+    // target rows per job when filtering a level
+    constexpr uint32_t MIP_ROWS_PER_JOB = 32;
+
+    struct TextureCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        SourceKey source;
+        uint32_t format;
+        uint32_t levelCount;
+        uint64_t dataOffset;
+        uint64_t dataSize;
+    };
+
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+    }
+
+    // texel block of every VkFormat the cache is written in, by numeric value
+    bool getFormatBlock(uint32_t format, uint32_t& blockExtent, uint32_t& blockBytes)
+    {
+        switch (format) {
+        case 37:    // VK_FORMAT_R8G8B8A8_UNORM
+        case 43:    // VK_FORMAT_R8G8B8A8_SRGB
+            blockExtent = 1;
+            blockBytes = 4;
+            return true;
+        case 131:   // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case 132:   // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+            blockExtent = 4;
+            blockBytes = 8;
+            return true;
+        case 137:   // VK_FORMAT_BC3_UNORM_BLOCK
+        case 138:   // VK_FORMAT_BC3_SRGB_BLOCK
+        case 145:   // VK_FORMAT_BC7_UNORM_BLOCK
+        case 146:   // VK_FORMAT_BC7_SRGB_BLOCK
+            blockExtent = 4;
+            blockBytes = 16;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    uint32_t fullMipCount(uint32_t width, uint32_t height)
+    {
+        uint32_t count = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size >>= 1) ++count;
+        return count;
+    }
+
+    float srgbToLinear(float value)
+    {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float value)
+    {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    uint8_t quantize(float value)
+    {
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+bool TextureCache::load(const std::string& cachePath, const std::string& sourcePath, uint32_t format)
+{
+    close();
+
+    if (!m_File.open(cachePath)) return false;
+
+    const uint8_t* pData = m_File.getData();
+    size_t fileSize = m_File.getSize();
+    if (fileSize < sizeof(TextureCacheHeader)) {
+        close();
+        return false;
+    }
+
+    TextureCacheHeader header;
+    memcpy(&header, pData, sizeof(header));
+
+    uint32_t blockExtent = 1;
+    uint32_t blockBytes = 0;
+    uint64_t levelsEnd = sizeof(TextureCacheHeader) + uint64_t(header.levelCount) * sizeof(TextureLevel);
+    bool valid = header.magic == TEXTURE_CACHE_MAGIC &&
+        header.version == VERSION &&
+        header.format == format &&
+        getFormatBlock(header.format, blockExtent, blockBytes) &&
+        header.levelCount > 0 && header.levelCount <= MAX_LEVELS &&
+        levelsEnd <= header.dataOffset &&
+        header.dataOffset <= fileSize && header.dataSize <= fileSize - header.dataOffset;
+
+    if (valid) {
+        m_View.levels.resize(header.levelCount);
+        memcpy(m_View.levels.data(), pData + sizeof(TextureCacheHeader), header.levelCount * sizeof(TextureLevel));
+
+        // every level halves the one before and holds exactly its blocks, the upload copies by extent
+        const TextureLevel& base = m_View.levels[0];
+        valid = base.width > 0 && base.height > 0 && header.levelCount <= fullMipCount(base.width, base.height);
+        for (uint32_t i = 0; valid && i < header.levelCount; ++i) {
+            const TextureLevel& level = m_View.levels[i];
+            if (i > 0) {
+                const TextureLevel& previous = m_View.levels[i - 1];
+                valid = level.width == std::max(1u, previous.width >> 1) &&
+                    level.height == std::max(1u, previous.height >> 1);
+            }
+            uint64_t blocksWide = (uint64_t(level.width) + blockExtent - 1) / blockExtent;
+            uint64_t blocksHigh = (uint64_t(level.height) + blockExtent - 1) / blockExtent;
+            valid = valid && level.size == blocksWide * blocksHigh * blockBytes &&
+                level.offset % LEVEL_ALIGNMENT == 0 &&
+                level.offset <= header.dataSize && level.size <= header.dataSize - level.offset;
+        }
+    }
+
+    valid = valid && SourceKey::matches(header.source, sourcePath);
+
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    m_View.format = header.format;
+    m_View.pData = pData + header.dataOffset;
+    m_View.dataSize = header.dataSize;
+    return true;
+}
+
+void TextureCache::close()
+{
+    m_File.close();
+    m_View = TextureView{};
+}
+
+bool TextureCache::store(const std::string& cachePath, const std::string& sourcePath, const TextureView& texture)
+{
+    TextureCacheHeader header{};
+    if (!SourceKey::compute(sourcePath, header.source)) return false;
+    header.magic = TEXTURE_CACHE_MAGIC;
+    header.version = VERSION;
+    header.format = texture.format;
+    header.levelCount = static_cast<uint32_t>(texture.levels.size());
+    uint64_t levelsSize = texture.levels.size() * sizeof(TextureLevel);
+    header.dataOffset = alignOffset(sizeof(header) + levelsSize);
+    header.dataSize = texture.dataSize;
+
+    const char padding[LEVEL_ALIGNMENT] = {};
+    return writeFileAtomic(cachePath, {
+        { &header, sizeof(header) },
+        { texture.levels.data(), levelsSize },
+        { padding, header.dataOffset - sizeof(header) - levelsSize },
+        { texture.pData, texture.dataSize },
+    });
+}
+
+std::vector<uint8_t> TextureCache::buildMipChain(const uint8_t* pixels, uint32_t width, uint32_t height,
+    bool srgb, std::vector<TextureLevel>& vecLevels, uint32_t threadCount)
+{
+    vecLevels.clear();
+    uint64_t offset = 0;
+    for (uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u)) {
+        vecLevels.push_back({ w, h, offset, uint64_t(w) * h * 4 });
+        offset = alignOffset(offset + uint64_t(w) * h * 4);
+        if (w == 1 && h == 1) break;
+    }
+
+    std::vector<uint8_t> vecTexels(offset, 0);
+    memcpy(vecTexels.data(), pixels, vecLevels[0].size);
+
+    float srgbTable[256];
+    for (int i = 0; i < 256; ++i)
+        srgbTable[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+
+    // filter from float texels so rounding does not accumulate down the chain
+    std::vector<float> vecSource(size_t(width) * height * 4);
+    for (size_t i = 0; i < vecSource.size(); ++i)
+        vecSource[i] = (i % 4 == 3) ? pixels[i] / 255.0f : srgbTable[pixels[i]];
+
+    std::vector<float> vecTarget;
+    for (size_t levelIndex = 1; levelIndex < vecLevels.size(); ++levelIndex) {
+        const TextureLevel& source = vecLevels[levelIndex - 1];
+        const TextureLevel& target = vecLevels[levelIndex];
+        vecTarget.assign(size_t(target.width) * target.height * 4, 0.0f);
+        uint8_t* pOut = vecTexels.data() + target.offset;
+
+        // rows only read the previous level, bands of them are independent
+        uint32_t bandCount = (target.height + MIP_ROWS_PER_JOB - 1) / MIP_ROWS_PER_JOB;
+        parallelFor(bandCount, threadCount, [&](size_t band) {
+            uint32_t yBegin = static_cast<uint32_t>(band) * MIP_ROWS_PER_JOB;
+            uint32_t yEnd = std::min(yBegin + MIP_ROWS_PER_JOB, target.height);
+            for (uint32_t y = yBegin; y < yEnd; ++y) {
+                uint32_t y0 = std::min(2 * y, source.height - 1);
+                uint32_t y1 = std::min(2 * y + 1, source.height - 1);
+                for (uint32_t x = 0; x < target.width; ++x) {
+                    uint32_t x0 = std::min(2 * x, source.width - 1);
+                    uint32_t x1 = std::min(2 * x + 1, source.width - 1);
+                    size_t dst = (size_t(y) * target.width + x) * 4;
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        float sum = vecSource[(size_t(y0) * source.width + x0) * 4 + c] +
+                            vecSource[(size_t(y0) * source.width + x1) * 4 + c] +
+                            vecSource[(size_t(y1) * source.width + x0) * 4 + c] +
+                            vecSource[(size_t(y1) * source.width + x1) * 4 + c];
+                        vecTarget[dst + c] = sum * 0.25f;
+                        bool encode = srgb && c != 3;
+                        pOut[dst + c] = quantize(encode ? linearToSrgb(vecTarget[dst + c]) : vecTarget[dst + c]);
+                    }
+                }
+            }
+        });
+        vecSource.swap(vecTarget);
+    }
+
+    return vecTexels;
+}
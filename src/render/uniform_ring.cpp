@@ -0,0 +1,41 @@
+#include "render/uniform_ring.h"
+
+#include <cstring>
+#include <stdexcept>
+
+void UniformRing::init(vk::Buffer buffer, void* pMapped, vk::DeviceSize frameSize, uint32_t frameCount, vk::DeviceSize alignment)
+{
+    if (!pMapped) throw std::runtime_error("uniform ring memory is not host visible!");
+
+    m_Buffer = buffer;
+    m_pMapped = static_cast<uint8_t*>(pMapped);
+    m_Alignment = alignment > 0 ? alignment : 1;
+    m_FrameSize = alignSize(frameSize, m_Alignment);
+    m_FrameCount = frameCount;
+    m_FrameBase = 0;
+    m_Cursor = 0;
+}
+
+vk::DeviceSize UniformRing::alignSize(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+void UniformRing::beginFrame(uint32_t frame)
+{
+    m_FrameBase = m_FrameSize * (frame % m_FrameCount);
+    m_Cursor = 0;
+}
+
+uint32_t UniformRing::push(const void* data, vk::DeviceSize size)
+{
+    vk::DeviceSize slotSize = alignSize(size, m_Alignment);
+    if (m_Cursor + slotSize > m_FrameSize)
+        throw std::runtime_error("uniform ring frame region exhausted!");
+
+    vk::DeviceSize offset = m_FrameBase + m_Cursor;
+    memcpy(m_pMapped + offset, data, size);
+    m_Cursor += slotSize;
+
+    return static_cast<uint32_t>(offset);
+}
@@ -0,0 +1,442 @@
+#include "render/upload_manager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    // satisfies copyBufferToImage offset rules for every texel size used here
+    constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+}
+
+void UploadManager::init(vk::Device device, DeviceAllocator* pAllocator,
+    uint32_t graphicsFamily, vk::Queue graphicsQueue,
+    std::optional<uint32_t> transferFamily, vk::Queue transferQueue, vk::Extent3D transferImageGranularity,
+    vk::DeviceSize stagingSize)
+{
+    m_Device = device;
+    m_pAllocator = pAllocator;
+
+    m_GraphicsFamily = graphicsFamily;
+    m_GraphicsQueue = graphicsQueue;
+    m_TransferFamily = transferFamily.value_or(graphicsFamily);
+    m_TransferQueue = transferFamily ? transferQueue : graphicsQueue;
+    // large levels are copied in bands of rows, which a coarser granularity does not allow
+    m_ImagesOnGraphicsQueue = hasDedicatedTransferQueue() && transferImageGranularity != vk::Extent3D(1, 1, 1);
+
+    vk::CommandPoolCreateInfo poolInfo{};
+    poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+        .setQueueFamilyIndex(m_GraphicsFamily);
+    m_GraphicsCommandPool = m_Device.createCommandPool(poolInfo);
+    if (!m_GraphicsCommandPool) throw std::runtime_error("failed to create upload command pool!");
+
+    if (hasDedicatedTransferQueue()) {
+        poolInfo.setQueueFamilyIndex(m_TransferFamily);
+        m_TransferCommandPool = m_Device.createCommandPool(poolInfo);
+        if (!m_TransferCommandPool) throw std::runtime_error("failed to create transfer command pool!");
+    } else {
+        m_TransferCommandPool = m_GraphicsCommandPool;
+    }
+
+    vk::BufferCreateInfo bufferInfo{};
+    bufferInfo.setSize(stagingSize)
+        .setUsage(vk::BufferUsageFlagBits::eTransferSrc)
+        .setSharingMode(vk::SharingMode::eExclusive);
+    m_StagingBuffer = m_Device.createBuffer(bufferInfo);
+    if (!m_StagingBuffer) throw std::runtime_error("failed to create staging buffer!");
+
+    vk::MemoryRequirements memRequirements = m_Device.getBufferMemoryRequirements(m_StagingBuffer);
+    uint32_t memoryType = m_pAllocator->getMemoryTypeSelector().select(memRequirements.memoryTypeBits,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        MemoryUsage::eUpload);
+    m_StagingMemory = m_pAllocator->allocate(memRequirements, memoryType, ResourceKind::eLinear);
+    m_Device.bindBufferMemory(m_StagingBuffer, m_StagingMemory.memory, m_StagingMemory.offset);
+
+    m_pStaging = static_cast<uint8_t*>(m_StagingMemory.pMapped);
+    if (!m_pStaging) throw std::runtime_error("staging memory is not host visible!");
+
+    m_StagingSize = stagingSize;
+    m_StagingChunkSize = std::max(stagingSize / 4, STAGING_ALIGNMENT);
+    m_StagingHead = 0;
+    m_StagingTail = 0;
+    m_StagingInUse = 0;
+}
+
+void UploadManager::destroy()
+{
+    wait(flush());
+
+    m_Device.destroyBuffer(m_StagingBuffer);
+    m_pAllocator->free(m_StagingMemory);
+    m_pStaging = nullptr;
+
+    if (m_TransferCommandPool != m_GraphicsCommandPool)
+        m_Device.destroyCommandPool(m_TransferCommandPool);
+    m_Device.destroyCommandPool(m_GraphicsCommandPool);
+}
+
+UploadManager::Batch& UploadManager::currentBatch()
+{
+    if (m_RecordingBatch) return *m_RecordingBatch;
+
+    vk::CommandBufferAllocateInfo allocInfo{};
+    allocInfo.setCommandPool(m_TransferCommandPool)
+        .setLevel(vk::CommandBufferLevel::ePrimary)
+        .setCommandBufferCount(1);
+
+    Batch batch{};
+    batch.transferCommandBuffer = m_Device.allocateCommandBuffers(allocInfo).front();
+
+    vk::CommandBufferBeginInfo beginInfo{};
+    beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    batch.transferCommandBuffer.begin(beginInfo);
+
+    m_RecordingBatch = std::move(batch);
+    return *m_RecordingBatch;
+}
+
+void UploadManager::recordImageCommands(GraphicsCommands commands)
+{
+    if (m_ImagesOnGraphicsQueue)
+        currentBatch().vecGraphicsCommands.push_back(std::move(commands));
+    else
+        commands(currentBatch().transferCommandBuffer);
+}
+
+vk::DeviceSize UploadManager::stage(const void* data, vk::DeviceSize size)
+{
+    if (size > m_StagingSize) throw std::runtime_error("upload chunk exceeds staging ring!");
+
+    for (;;) {
+        if (m_StagingInUse == 0) {
+            m_StagingHead = 0;
+            m_StagingTail = 0;
+        }
+
+        vk::DeviceSize offset = (m_StagingHead + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+        bool fits = false;
+        if (m_StagingInUse == 0 || m_StagingHead > m_StagingTail) {
+            // free space is [head, end) followed by [0, tail)
+            if (offset + size <= m_StagingSize) {
+                fits = true;
+            } else if (size <= m_StagingTail) {
+                offset = 0;
+                fits = true;
+            }
+        } else {
+            // wrapped, free space is [head, tail)
+            fits = offset + size <= m_StagingTail;
+        }
+
+        if (fits) {
+            // skipped bytes belong to this chunk until its batch retires
+            vk::DeviceSize consumed = offset >= m_StagingHead ?
+                offset - m_StagingHead + size : m_StagingSize - m_StagingHead + size;
+
+            Batch& batch = currentBatch();
+            memcpy(m_pStaging + offset, data, size);
+            m_StagingHead = offset + size;
+            m_StagingInUse += consumed;
+            batch.stagingBytes += consumed;
+            batch.stagingEnd = m_StagingHead;
+            return offset;
+        }
+
+        // the oldest in-flight batch owns the space right after the tail
+        if (!m_InFlightBatches.empty()) {
+            const auto& _ = m_Device.waitForFences(m_InFlightBatches.front().fence, true, std::numeric_limits<uint64_t>::max());
+            poll();
+        } else if (m_RecordingBatch && m_RecordingBatch->stagingBytes > 0) {
+            flush();
+        } else {
+            throw std::runtime_error("staging ring cannot fit upload chunk!");
+        }
+    }
+}
+
+void UploadManager::uploadBuffer(vk::Buffer dst, const void* data, vk::DeviceSize size, vk::DeviceSize dstOffset,
+    vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess)
+{
+    if (size == 0) return;
+
+    // chunks may land in different batches; they all run on the transfer queue,
+    // so only the batch holding the last one releases the range
+    const uint8_t* pSrc = static_cast<const uint8_t*>(data);
+    for (vk::DeviceSize copied = 0; copied < size;) {
+        vk::DeviceSize chunk = std::min(size - copied, m_StagingChunkSize);
+        vk::DeviceSize offset = stage(pSrc + copied, chunk);
+
+        vk::BufferCopy region{};
+        region.setSrcOffset(offset)
+            .setDstOffset(dstOffset + copied)
+            .setSize(chunk);
+        currentBatch().transferCommandBuffer.copyBuffer(m_StagingBuffer, dst, region);
+
+        copied += chunk;
+    }
+
+    Batch& batch = currentBatch();
+    bool dedicated = hasDedicatedTransferQueue();
+    vk::BufferMemoryBarrier barrier{};
+    barrier.setBuffer(dst)
+        .setOffset(dstOffset)
+        .setSize(size)
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(dstAccess)
+        .setSrcQueueFamilyIndex(dedicated ? m_TransferFamily : VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(dedicated ? m_GraphicsFamily : VK_QUEUE_FAMILY_IGNORED);
+
+    batch.vecBufferAcquires.push_back(barrier);
+    batch.acquireStages |= dstStage;
+}
+
+void UploadManager::uploadImage(vk::Image image, const void* data, const std::vector<TextureLevel>& levels,
+    uint32_t blockExtent)
+{
+    if (levels.empty()) return;
+
+    vk::ImageSubresourceRange allLevels(vk::ImageAspectFlagBits::eColor, 0, static_cast<uint32_t>(levels.size()), 0, 1);
+
+    vk::ImageMemoryBarrier toTransferDst{};
+    toTransferDst.setOldLayout(vk::ImageLayout::eUndefined)
+        .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setImage(image)
+        .setSubresourceRange(allLevels)
+        .setSrcAccessMask(vk::AccessFlags{0})
+        .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+
+    recordImageCommands([toTransferDst](vk::CommandBuffer commandBuffer) {
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::DependencyFlags{0},
+            nullptr, nullptr, toTransferDst);
+    });
+
+    // consecutive levels that fit one chunk share a staging range and one copy
+    const uint8_t* pSrc = static_cast<const uint8_t*>(data);
+    for (size_t first = 0; first < levels.size();) {
+        if (levels[first].size > m_StagingChunkSize) {
+            stageImageRows(image, pSrc + levels[first].offset, levels[first], static_cast<uint32_t>(first), blockExtent);
+            ++first;
+            continue;
+        }
+
+        size_t last = first;
+        while (last + 1 < levels.size() &&
+            levels[last + 1].offset + levels[last + 1].size - levels[first].offset <= m_StagingChunkSize)
+            ++last;
+
+        vk::DeviceSize groupSize = levels[last].offset + levels[last].size - levels[first].offset;
+        vk::DeviceSize offset = stage(pSrc + levels[first].offset, groupSize);
+
+        std::vector<vk::BufferImageCopy> vecRegions;
+        for (size_t level = first; level <= last; ++level)
+            vecRegions.push_back(imageCopyRegion(offset + levels[level].offset - levels[first].offset,
+                static_cast<uint32_t>(level), 0, levels[level].width, levels[level].height));
+        vk::Buffer stagingBuffer = m_StagingBuffer;
+        recordImageCommands([stagingBuffer, image, vecRegions](vk::CommandBuffer commandBuffer) {
+            commandBuffer.copyBufferToImage(stagingBuffer, image, vk::ImageLayout::eTransferDstOptimal, vecRegions);
+        });
+
+        first = last + 1;
+    }
+
+    bool dedicated = hasDedicatedTransferQueue() && !m_ImagesOnGraphicsQueue;
+    vk::ImageMemoryBarrier barrier{};
+    barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+        .setSrcQueueFamilyIndex(dedicated ? m_TransferFamily : VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(dedicated ? m_GraphicsFamily : VK_QUEUE_FAMILY_IGNORED)
+        .setImage(image)
+        .setSubresourceRange(allLevels)
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+    // acquires run before the graphics commands, an image copied there is finished in order instead
+    if (m_ImagesOnGraphicsQueue) {
+        recordGraphics([barrier](vk::CommandBuffer commandBuffer) {
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                vk::PipelineStageFlagBits::eFragmentShader,
+                vk::DependencyFlags{0},
+                nullptr, nullptr, barrier);
+        });
+        return;
+    }
+
+    Batch& batch = currentBatch();
+    batch.vecImageAcquires.push_back(barrier);
+    batch.acquireStages |= vk::PipelineStageFlagBits::eFragmentShader;
+}
+
+void UploadManager::stageImageRows(vk::Image image, const uint8_t* pSrc, const TextureLevel& level, uint32_t mipLevel,
+    uint32_t blockExtent)
+{
+    uint32_t blockRows = (level.height + blockExtent - 1) / blockExtent;
+    vk::DeviceSize rowPitch = level.size / blockRows;
+    if (rowPitch > m_StagingChunkSize) throw std::runtime_error("texture row exceeds staging chunk!");
+
+    // split by whole block rows, same batching rules as uploadBuffer
+    uint32_t rowsPerChunk = static_cast<uint32_t>(m_StagingChunkSize / rowPitch);
+    for (uint32_t row = 0; row < blockRows;) {
+        uint32_t rows = std::min(rowsPerChunk, blockRows - row);
+        vk::DeviceSize offset = stage(pSrc + row * rowPitch, rows * rowPitch);
+        // the last band may end inside a block, the copy extent stops at the level edge
+        uint32_t texelRow = row * blockExtent;
+        uint32_t texelRows = std::min(rows * blockExtent, level.height - texelRow);
+        vk::Buffer stagingBuffer = m_StagingBuffer;
+        vk::BufferImageCopy region = imageCopyRegion(offset, mipLevel, texelRow, level.width, texelRows);
+        recordImageCommands([stagingBuffer, image, region](vk::CommandBuffer commandBuffer) {
+            commandBuffer.copyBufferToImage(stagingBuffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+        });
+        row += rows;
+    }
+}
+
+vk::BufferImageCopy UploadManager::imageCopyRegion(vk::DeviceSize bufferOffset, uint32_t mipLevel,
+    uint32_t row, uint32_t width, uint32_t rows)
+{
+    vk::BufferImageCopy region{};
+    region.setBufferOffset(bufferOffset)
+        .setBufferRowLength(0)
+        .setBufferImageHeight(0)
+        .setImageSubresource(vk::ImageSubresourceLayers(
+            vk::ImageAspectFlagBits::eColor,
+            mipLevel, 0, 1))
+        .setImageOffset(vk::Offset3D(0, static_cast<int32_t>(row), 0))
+        .setImageExtent(vk::Extent3D(width, rows, 1));
+    return region;
+}
+
+void UploadManager::recordGraphics(GraphicsCommands commands)
+{
+    currentBatch().vecGraphicsCommands.push_back(std::move(commands));
+}
+
+UploadManager::Ticket UploadManager::flush()
+{
+    if (!m_RecordingBatch) return m_NextTicket - 1;
+
+    Batch batch = std::move(*m_RecordingBatch);
+    m_RecordingBatch.reset();
+
+    bool dedicated = hasDedicatedTransferQueue();
+    bool hasBarriers = !batch.vecBufferAcquires.empty() || !batch.vecImageAcquires.empty();
+
+    vk::CommandBuffer graphicsCommandBuffer = batch.transferCommandBuffer;
+    vk::PipelineStageFlags acquireSrcStage = vk::PipelineStageFlagBits::eTransfer;
+
+    if (dedicated) {
+        // release half of the ownership transfer, destination access is ignored here
+        std::vector<vk::BufferMemoryBarrier> bufferReleases = batch.vecBufferAcquires;
+        std::vector<vk::ImageMemoryBarrier> imageReleases = batch.vecImageAcquires;
+        for (auto& barrier : bufferReleases) barrier.setDstAccessMask(vk::AccessFlags{0});
+        for (auto& barrier : imageReleases) barrier.setDstAccessMask(vk::AccessFlags{0});
+
+        if (hasBarriers)
+            batch.transferCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                vk::PipelineStageFlagBits::eBottomOfPipe,
+                vk::DependencyFlags{0},
+                nullptr, bufferReleases, imageReleases);
+        batch.transferCommandBuffer.end();
+
+        // acquire half, the semaphore already orders it after the transfer
+        for (auto& barrier : batch.vecBufferAcquires) barrier.setSrcAccessMask(vk::AccessFlags{0});
+        for (auto& barrier : batch.vecImageAcquires) barrier.setSrcAccessMask(vk::AccessFlags{0});
+        acquireSrcStage = vk::PipelineStageFlagBits::eTopOfPipe;
+
+        vk::CommandBufferAllocateInfo allocInfo{};
+        allocInfo.setCommandPool(m_GraphicsCommandPool)
+            .setLevel(vk::CommandBufferLevel::ePrimary)
+            .setCommandBufferCount(1);
+        graphicsCommandBuffer = m_Device.allocateCommandBuffers(allocInfo).front();
+        batch.graphicsCommandBuffer = graphicsCommandBuffer;
+
+        vk::CommandBufferBeginInfo beginInfo{};
+        beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        graphicsCommandBuffer.begin(beginInfo);
+
+        batch.ownershipSemaphore = m_Device.createSemaphore(vk::SemaphoreCreateInfo{});
+    }
+
+    if (hasBarriers)
+        graphicsCommandBuffer.pipelineBarrier(acquireSrcStage, batch.acquireStages,
+            vk::DependencyFlags{0},
+            nullptr, batch.vecBufferAcquires, batch.vecImageAcquires);
+
+    for (auto& commands : batch.vecGraphicsCommands)
+        commands(graphicsCommandBuffer);
+    batch.vecGraphicsCommands.clear();
+
+    graphicsCommandBuffer.end();
+
+    batch.fence = m_Device.createFence(vk::FenceCreateInfo{});
+
+    if (dedicated) {
+        vk::SubmitInfo transferSubmit{};
+        transferSubmit.setCommandBuffers(batch.transferCommandBuffer)
+            .setSignalSemaphores(batch.ownershipSemaphore);
+        m_TransferQueue.submit(transferSubmit, nullptr);
+
+        vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+        vk::SubmitInfo graphicsSubmit{};
+        graphicsSubmit.setWaitSemaphores(batch.ownershipSemaphore)
+            .setWaitDstStageMask(waitStage)
+            .setCommandBuffers(graphicsCommandBuffer);
+        m_GraphicsQueue.submit(graphicsSubmit, batch.fence);
+    } else {
+        vk::SubmitInfo submitInfo{};
+        submitInfo.setCommandBuffers(graphicsCommandBuffer);
+        m_GraphicsQueue.submit(submitInfo, batch.fence);
+    }
+
+    batch.ticket = m_NextTicket++;
+    Ticket ticket = batch.ticket;
+    m_InFlightBatches.push_back(std::move(batch));
+    return ticket;
+}
+
+void UploadManager::poll()
+{
+    while (!m_InFlightBatches.empty()) {
+        Batch& batch = m_InFlightBatches.front();
+        if (m_Device.getFenceStatus(batch.fence) != vk::Result::eSuccess) break;
+
+        m_CompletedTicket = batch.ticket;
+        retire(batch);
+        m_InFlightBatches.pop_front();
+    }
+}
+
+bool UploadManager::isComplete(Ticket ticket)
+{
+    poll();
+    return ticket <= m_CompletedTicket;
+}
+
+void UploadManager::wait(Ticket ticket)
+{
+    for (const auto& batch : m_InFlightBatches) {
+        if (batch.ticket > ticket) break;
+        const auto& _ = m_Device.waitForFences(batch.fence, true, std::numeric_limits<uint64_t>::max());
+    }
+    poll();
+}
+
+void UploadManager::retire(Batch& batch)
+{
+    // batches retire in submission order, so the tail just follows them
+    if (batch.stagingBytes > 0) {
+        m_StagingInUse -= batch.stagingBytes;
+        m_StagingTail = batch.stagingEnd;
+    }
+
+    m_Device.freeCommandBuffers(m_TransferCommandPool, batch.transferCommandBuffer);
+    if (batch.graphicsCommandBuffer)
+        m_Device.freeCommandBuffers(m_GraphicsCommandPool, batch.graphicsCommandBuffer);
+    if (batch.ownershipSemaphore)
+        m_Device.destroySemaphore(batch.ownershipSemaphore);
+    m_Device.destroyFence(batch.fence);
+}
@@ -0,0 +1,215 @@
+#include "render/vertex_dedup.h"
+#include "render/parallel_for.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+    constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    size_t nextPowerOfTwo(size_t value)
+    {
+        size_t result = 1;
+        while (result < value) result <<= 1;
+        return result;
+    }
+
+    inline bool equalVertices(const float* a, const float* b, uint32_t floatsPerVertex)
+    {
+        for (uint32_t i = 0; i < floatsPerVertex; ++i)
+            if (!(a[i] == b[i])) return false;
+        return true;
+    }
+
+    // Maps every vertex to the first vertex equal to it.
+    class DedupTable {
+    public:
+        DedupTable(const float* data, uint32_t floatsPerVertex, size_t expectedCount)
+            : m_pData(data), m_FloatsPerVertex(floatsPerVertex)
+        {
+            // meshes typically weld 4-6 corners into one vertex, half the
+            // corner count keeps the load factor low without a rehash
+            m_vecSlots.assign(nextPowerOfTwo(std::max<size_t>(16, expectedCount / 2)), Slot{ 0, EMPTY_SLOT });
+            m_Mask = m_vecSlots.size() - 1;
+        }
+
+        // Returns the first vertex equal to vertex, or vertex itself when it is new.
+        uint32_t findOrInsert(uint32_t vertex, uint64_t hash)
+        {
+            const float* pVertex = m_pData + size_t(vertex) * m_FloatsPerVertex;
+            uint32_t tag = static_cast<uint32_t>(hash >> 32);
+
+            for (size_t slot = hash & m_Mask;; slot = (slot + 1) & m_Mask) {
+                Slot& entry = m_vecSlots[slot];
+                if (entry.first == EMPTY_SLOT) {
+                    entry = Slot{ tag, vertex };
+                    if (++m_Count * 4 > m_vecSlots.size() * 3) grow();
+                    return vertex;
+                }
+                if (entry.tag == tag &&
+                    equalVertices(m_pData + size_t(entry.first) * m_FloatsPerVertex, pVertex, m_FloatsPerVertex))
+                    return entry.first;
+            }
+        }
+
+    private:
+        struct Slot {
+            uint32_t tag;
+            uint32_t first;
+        };
+
+        void grow()
+        {
+            std::vector<Slot> vecOld;
+            vecOld.swap(m_vecSlots);
+            m_vecSlots.assign(vecOld.size() * 2, Slot{ 0, EMPTY_SLOT });
+            m_Mask = m_vecSlots.size() - 1;
+
+            for (const Slot& entry : vecOld) {
+                if (entry.first == EMPTY_SLOT) continue;
+                uint64_t hash = VertexDedup::hashVertex(m_pData + size_t(entry.first) * m_FloatsPerVertex, m_FloatsPerVertex);
+                size_t slot = hash & m_Mask;
+                while (m_vecSlots[slot].first != EMPTY_SLOT) slot = (slot + 1) & m_Mask;
+                m_vecSlots[slot] = entry;
+            }
+        }
+
+        const float* m_pData;
+        uint32_t m_FloatsPerVertex;
+        std::vector<Slot> m_vecSlots;
+        size_t m_Mask = 0;
+        size_t m_Count = 0;
+    };
+}
+
+uint64_t VertexDedup::hashVertex(const float* vertex, uint32_t floatsPerVertex)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ floatsPerVertex;
+    for (uint32_t i = 0; i < floatsPerVertex; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &vertex[i], sizeof(bits));
+        if (bits == 0x80000000u) bits = 0;
+        hash = (hash ^ bits) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+
+    // murmur3 finalizer, spreads the words over both halves
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void VertexDedup::weld(const float* data, uint32_t floatsPerVertex, size_t vertexCount,
+    std::vector<uint32_t>& vecIndices, std::vector<uint32_t>& vecFirstOccurrences,
+    uint32_t threadCount)
+{
+    if (vertexCount >= EMPTY_SLOT) throw std::runtime_error("too many vertices to weld!");
+
+    vecIndices.resize(vertexCount);
+    vecFirstOccurrences.clear();
+
+    if (threadCount <= 1 || vertexCount < BLOCK_SIZE) {
+        DedupTable table(data, floatsPerVertex, vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i) {
+            uint32_t first = table.findOrInsert(i, hashVertex(data + size_t(i) * floatsPerVertex, floatsPerVertex));
+            if (first == i) {
+                vecIndices[i] = static_cast<uint32_t>(vecFirstOccurrences.size());
+                vecFirstOccurrences.push_back(i);
+            } else {
+                vecIndices[i] = vecIndices[first];
+            }
+        }
+        return;
+    }
+
+    // Shards are picked by the top hash bits, tables index with the low ones.
+    // Each shard sees its vertices in input order, so the first vertex it
+    // finds for a key is the global first occurrence.
+    size_t shardCount = nextPowerOfTwo(size_t(threadCount) * 4);
+    uint32_t shardShift = 64;
+    for (size_t s = shardCount; s > 1; s >>= 1) --shardShift;
+    size_t blockCount = (vertexCount + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    std::vector<uint64_t> vecHashes(vertexCount);
+    std::vector<size_t> vecBlockShardCounts(blockCount * shardCount, 0);
+    parallelFor(blockCount, threadCount, [&](size_t block) {
+        size_t begin = block * BLOCK_SIZE;
+        size_t end = std::min(begin + BLOCK_SIZE, vertexCount);
+        size_t* pCounts = &vecBlockShardCounts[block * shardCount];
+        for (size_t i = begin; i < end; ++i) {
+            vecHashes[i] = hashVertex(data + i * floatsPerVertex, floatsPerVertex);
+            ++pCounts[vecHashes[i] >> shardShift];
+        }
+    });
+
+    // per shard: block 0's vertices, then block 1's, ...
+    std::vector<size_t> vecShardBegin(shardCount + 1, 0);
+    std::vector<size_t> vecBlockShardOffsets(blockCount * shardCount);
+    size_t offset = 0;
+    for (size_t shard = 0; shard < shardCount; ++shard) {
+        vecShardBegin[shard] = offset;
+        for (size_t block = 0; block < blockCount; ++block) {
+            vecBlockShardOffsets[block * shardCount + shard] = offset;
+            offset += vecBlockShardCounts[block * shardCount + shard];
+        }
+    }
+    vecShardBegin[shardCount] = offset;
+
+    std::vector<uint32_t> vecShardVertices(vertexCount);
+    parallelFor(blockCount, threadCount, [&](size_t block) {
+        size_t begin = block * BLOCK_SIZE;
+        size_t end = std::min(begin + BLOCK_SIZE, vertexCount);
+        size_t* pOffsets = &vecBlockShardOffsets[block * shardCount];
+        for (size_t i = begin; i < end; ++i)
+            vecShardVertices[pOffsets[vecHashes[i] >> shardShift]++] = static_cast<uint32_t>(i);
+    });
+
+    // vecFirst[i] == i marks a first occurrence
+    std::vector<uint32_t> vecFirst(vertexCount);
+    parallelFor(shardCount, threadCount, [&](size_t shard) {
+        size_t begin = vecShardBegin[shard];
+        size_t end = vecShardBegin[shard + 1];
+        DedupTable table(data, floatsPerVertex, end - begin);
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t i = vecShardVertices[k];
+            vecFirst[i] = table.findOrInsert(i, vecHashes[i]);
+        }
+    });
+
+    // number first occurrences in input order
+    std::vector<size_t> vecBlockUniqueBase(blockCount + 1, 0);
+    parallelFor(blockCount, threadCount, [&](size_t block) {
+        size_t begin = block * BLOCK_SIZE;
+        size_t end = std::min(begin + BLOCK_SIZE, vertexCount);
+        size_t count = 0;
+        for (size_t i = begin; i < end; ++i) count += vecFirst[i] == i;
+        vecBlockUniqueBase[block + 1] = count;
+    });
+    for (size_t block = 0; block < blockCount; ++block)
+        vecBlockUniqueBase[block + 1] += vecBlockUniqueBase[block];
+
+    vecFirstOccurrences.resize(vecBlockUniqueBase[blockCount]);
+    parallelFor(blockCount, threadCount, [&](size_t block) {
+        size_t begin = block * BLOCK_SIZE;
+        size_t end = std::min(begin + BLOCK_SIZE, vertexCount);
+        uint32_t next = static_cast<uint32_t>(vecBlockUniqueBase[block]);
+        for (size_t i = begin; i < end; ++i) {
+            if (vecFirst[i] != i) continue;
+            vecIndices[i] = next;
+            vecFirstOccurrences[next++] = static_cast<uint32_t>(i);
+        }
+    });
+
+    // only first occurrences are read here and they were all written above
+    parallelFor(blockCount, threadCount, [&](size_t block) {
+        size_t begin = block * BLOCK_SIZE;
+        size_t end = std::min(begin + BLOCK_SIZE, vertexCount);
+        for (size_t i = begin; i < end; ++i)
+            if (vecFirst[i] != i) vecIndices[i] = vecIndices[vecFirst[i]];
+    });
+}
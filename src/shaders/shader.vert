@@ -4,17 +4,45 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
+    // quantized vertices decode as stored * scale + offset, identity for floats
+    vec4 positionScale;
+    vec4 positionOffset;
+    // xy scale, zw offset
+    vec4 texCoordTransform;
 } ubo;
 
+// affine instance transform, first three rows of the model matrix
+struct Instance {
+    vec4 rows[3];
+};
+
+layout(std430, binding = 2) readonly buffer InstanceBuffer {
+    Instance instances[];
+};
+
+// survivors of cull.comp, one run per LOD
+layout(std430, binding = 3) readonly buffer VisibleInstances {
+    uint visibleInstances[];
+};
+
+// start of the drawn LOD's run when firstInstance cannot carry it
+layout(push_constant) uniform DrawConstants {
+    uint visibleBase;
+} draw;
+
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0f);
-    fragColor = inColor;
-    fragTexCoord = inTexCoord;
+    vec3 position = inPosition * ubo.positionScale.xyz + ubo.positionOffset.xyz;
+    Instance instance = instances[visibleInstances[draw.visibleBase + gl_InstanceIndex]];
+    vec4 local = vec4(position, 1.0f);
+    vec3 world = vec3(dot(instance.rows[0], local), dot(instance.rows[1], local), dot(instance.rows[2], local));
+    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(world, 1.0f);
+    // loadModel only ever wrote white, the compact layout drops the attribute
+    fragColor = vec3(1.0f);
+    fragTexCoord = inTexCoord * ubo.texCoordTransform.xy + ubo.texCoordTransform.zw;
 }
\ No newline at end of file
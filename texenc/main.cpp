@@ -0,0 +1,97 @@
+#include "render/block_encoder.h"
+#include "render/parallel_for.h"
+#include "render/texture_cache.h"
+#include <utils/stb_image.h>
+#include <vulkan/vulkan.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+// Bakes an image into a texture cache holding its whole mip chain, so the
+// renderer maps it instead of decoding and encoding at startup.
+//   learnVulkan_texenc <image> [--out path] [--format bc1|bc3|bc7|rgba8] [--linear] [--threads N]
+// The default output sits next to the image with a .texcache extension.
+int main(int argc, char *argv[]) {
+    std::string imagePath;
+    std::string outPath;
+    std::string formatName = "bc7";
+    bool srgb = true;
+    uint32_t threadCount = defaultThreadCount();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            outPath = argv[++i];
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+            formatName = argv[++i];
+        else if (strcmp(argv[i], "--linear") == 0)
+            srgb = false;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threadCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else
+            imagePath = argv[i];
+    }
+
+    vk::Format format;
+    BlockFormat blockFormat = BlockFormat::eBC7;
+    bool compressed = true;
+    if (formatName == "bc1") {
+        format = srgb ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eBc1RgbUnormBlock;
+        blockFormat = BlockFormat::eBC1;
+    } else if (formatName == "bc3") {
+        format = srgb ? vk::Format::eBc3SrgbBlock : vk::Format::eBc3UnormBlock;
+        blockFormat = BlockFormat::eBC3;
+    } else if (formatName == "bc7") {
+        format = srgb ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+    } else if (formatName == "rgba8") {
+        format = srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+        compressed = false;
+    } else {
+        std::cerr << "unknown format " << formatName << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (imagePath.empty()) {
+        std::cerr << "usage: learnVulkan_texenc <image> [--out path] [--format bc1|bc3|bc7|rgba8] [--linear] [--threads N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (outPath.empty())
+        outPath = std::filesystem::path(imagePath).replace_extension(".texcache").string();
+
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(imagePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        std::cerr << "failed to load " << imagePath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    TextureView texture;
+    std::vector<uint8_t> vecTexels = TextureCache::buildMipChain(pixels, width, height, srgb, texture.levels, threadCount);
+    stbi_image_free(pixels);
+    uint64_t uncompressedSize = vecTexels.size();
+    double mipMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (compressed) {
+        std::vector<TextureLevel> vecSourceLevels;
+        vecSourceLevels.swap(texture.levels);
+        vecTexels = BlockEncoder::encodeMipChain(blockFormat, vecTexels.data(), vecSourceLevels, texture.levels, threadCount);
+    }
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    texture.format = static_cast<uint32_t>(format);
+    texture.pData = vecTexels.data();
+    texture.dataSize = vecTexels.size();
+    if (!TextureCache::store(outPath, imagePath, texture)) {
+        std::cerr << "failed to write " << outPath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << imagePath << ", " << width << "x" << height << ", " << texture.levels.size() << " levels\n"
+              << formatName << ": " << texture.dataSize << " bytes, "
+              << static_cast<double>(uncompressedSize) / texture.dataSize << "x smaller than rgba8\n"
+              << "mips " << mipMs << " ms, encode " << totalMs - mipMs << " ms on " << threadCount << " threads\n"
+              << "wrote " << outPath << "\n";
+    return EXIT_SUCCESS;
+}